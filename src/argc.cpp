@@ -93,11 +93,60 @@ void ARGC::showHelp()
     std::cout << "  -h, --help         Show this help message" << std::endl;
     std::cout << "  --port=<port>      Set HTTP server port (default: 80)" << std::endl;
     std::cout << "  --image=<file>     Set image file name (default: image.img)" << std::endl;
+    std::cout << "  --capture-buffer=<MiB>" << std::endl;
+    std::cout << "                     Set kernel capture buffer size, at most 2047 (default: 16)" << std::endl;
+    std::cout << "  --capture-timeout=<ms>" << std::endl;
+    std::cout << "                     Use a buffered read timeout instead of immediate mode," << std::endl;
+    std::cout << "                     at most 60000 (default: immediate mode)" << std::endl;
+    std::cout << "  --capture-ring=<n> Set packet handoff ring capacity in slots (default: 1024)" << std::endl;
+    std::cout << "  --connections=<n>  Parallel connections for the image download (default: 4)" << std::endl;
+    std::cout << "  --chunk-size=<MiB> Size of each ranged download request (default: 8)" << std::endl;
+    std::cout << "  --ota-server=<host[:port]>" << std::endl;
+    std::cout << "                     OTA server to query (default: iotapi.abupdate.com)" << std::endl;
+    std::cout << "  --http-timeout=<ms>" << std::endl;
+    std::cout << "                     Connect and receive timeout for HTTP requests (default: 30000)" << std::endl;
+    std::cout << "  --ota-cache-ttl=<seconds>" << std::endl;
+    std::cout << "                     Reuse checkVersion responses this fresh, 0 to always ask (default: 3600)" << std::endl;
+    std::cout << "  --cache-dir=<dir>  Directory for cached firmware images (default: cache)" << std::endl;
+    std::cout << "  --cache-size=<MiB> Evict least recently used images above this size (default: 8192)" << std::endl;
+    std::cout << "  --no-cache         Download straight into the image file" << std::endl;
+    std::cout << "  --no-prefetch      Do not fetch the most served image while waiting for a pen" << std::endl;
+    std::cout << "  --stream           Serve while downloading; asks for the password first" << std::endl;
+    std::cout << "  --fleet            Keep capturing and serve every pen with its own password and image" << std::endl;
+    std::cout << "  --fleet-downloads=<n>" << std::endl;
+    std::cout << "                     Jobs downloading at the same time in fleet mode (default: 2)" << std::endl;
+    std::cout << "  --fleet-hashes=<n> Jobs hashing at the same time in fleet mode (default: CPU count)" << std::endl;
+    std::cout << "  --batch            Never wait for the keyboard; exit once the pen reports its download" << std::endl;
+    std::cout << "  --batch-timeout=<seconds>" << std::endl;
+    std::cout << "                     Give up waiting for the pen in batch mode (default: 1800)" << std::endl;
+    std::cout << "  --lang=<en|zh>     Interface language instead of asking" << std::endl;
+    std::cout << "  --password=<text>  New password instead of asking" << std::endl;
+    std::cout << "  --password-file=<file>" << std::endl;
+    std::cout << "                     New passwords, one line per pen in capture order" << std::endl;
+    std::cout << "  --patterns=<list>  Password record formats to search for, comma separated:" << std::endl;
+    std::cout << "                     sha256sum, md5sum, md5crypt, sha256crypt, sha512crypt" << std::endl;
+    std::cout << "                     (default: sha256sum,md5sum; sha512crypt is detected only)" << std::endl;
+    std::cout << "  --overwrite=<yes|no|ask>" << std::endl;
+    std::cout << "                     Replace an existing image file (default: ask, yes in batch mode)" << std::endl;
+    std::cout << "  --no-resume        Start over instead of resuming an unfinished session" << std::endl;
+    std::cout << "  --trace=<file>     Write stage timings as a Chrome trace (chrome://tracing, Perfetto)" << std::endl;
+    std::cout << "  --capture-address=<ip>" << std::endl;
+    std::cout << "                     Capture on interfaces in this subnet (default: 192.168.137.1)" << std::endl;
+    std::cout << "  --capture-netmask=<mask>" << std::endl;
+    std::cout << "                     Subnet mask for --capture-address (default: each" << std::endl;
+    std::cout << "                     interface's own mask, or /24 if it has none)" << std::endl;
+    std::cout << "  --replay=<file>    Read packets from a capture file instead of the hotspot" << std::endl;
+    std::cout << "  --capture-stats=<seconds>" << std::endl;
+    std::cout << "                     Print capture statistics periodically (press [s] any time)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Exit codes:" << std::endl;
+    std::cout << "  0 done, 1 fatal error, 2 not running as administrator (batch), 3 pen timed out (batch)" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  paper --verbose" << std::endl;
     std::cout << "  paper --port=8080 --image=firmware.img" << std::endl;
     std::cout << "  paper -v --port=9000" << std::endl;
+    std::cout << "  paper --batch --lang=en --password-file=passwords.txt" << std::endl;
 }
 
 std::string ARGC::GetArg(const std::string &key, const std::string &defaultValue)
@@ -108,6 +157,25 @@ std::string ARGC::GetArg(const std::string &key, const std::string &defaultValue
     return defaultValue;
 }
 
+long long ARGC::GetIntArg(const std::string &key, long long defaultValue)
+{
+    auto it = args.find(key);
+    if (it == args.end())
+        return defaultValue;
+    try
+    {
+        size_t pos = 0;
+        long long value = std::stoll(it->second, &pos);
+        if (pos == it->second.length())
+            return value;
+    }
+    catch (const std::exception &)
+    {
+    }
+    IO::Warn(t("invalid_numeric_argument") + ": --" + key + "=" + it->second);
+    return defaultValue;
+}
+
 bool ARGC::HasArg(const std::string &key)
 {
     return args.find(key) != args.end();
@@ -32,5 +32,6 @@ private:
 public:
     static void Initialize(int argc, char *argv[]);
     static std::string GetArg(const std::string &key, const std::string &defaultValue = "");
+    static long long GetIntArg(const std::string &key, long long defaultValue);
     static bool HasArg(const std::string &key);
 };
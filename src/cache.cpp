@@ -0,0 +1,469 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "cache.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include "argc.hpp"
+#include "hash.hpp"
+#include "download.hpp"
+#include "mappedFile.hpp"
+#include "trace.hpp"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <cstring>
+
+std::mutex CACHE::indexMutex;
+std::set<std::string> CACHE::servedKeys;
+
+std::mutex &CACHE::entryMutex(const std::string &key)
+{
+    static std::mutex mapMutex;
+    static std::map<std::string, std::mutex> entryMutexes;
+    std::lock_guard<std::mutex> lock(mapMutex);
+    return entryMutexes[key];
+}
+
+std::string CACHE::directory()
+{
+    const std::string cacheDirectory = ARGC::GetArg("cache-dir", "cache");
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (error)
+        DIE(t("failed_create_cache_directory") + ": " + cacheDirectory + " (" + error.message() + ")");
+    return cacheDirectory;
+}
+
+long long CACHE::currentTime()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string CACHE::keyFor(const std::string &url, const std::string &md5)
+{
+    std::string key = md5;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    if (key.length() != 32 || !std::all_of(key.begin(), key.end(), [](char c)
+                                           { return std::isxdigit(static_cast<unsigned char>(c)); }))
+        key = "url-" + HASH::MD5(url);
+    return key;
+}
+
+std::string CACHE::entryPath(const std::string &key)
+{
+    return (std::filesystem::path(directory()) / (key + ".img")).string();
+}
+
+nlohmann::json CACHE::loadIndex(const std::string &name)
+{
+    std::ifstream file((std::filesystem::path(directory()) / name).string());
+    if (file.is_open())
+    {
+        try
+        {
+            nlohmann::json index = nlohmann::json::parse(file);
+            if (index.is_object())
+                return index;
+        }
+        catch (const nlohmann::json::exception &e)
+        {
+            IO::Warn(t("cache_index_corrupted") + ": " + e.what());
+        }
+    }
+    return nlohmann::json::object();
+}
+
+void CACHE::saveIndex(const std::string &name, const nlohmann::json &index)
+{
+    const std::filesystem::path indexPath = std::filesystem::path(directory()) / name;
+    const std::filesystem::path temporaryPath = indexPath.string() + ".tmp";
+    {
+        std::ofstream file(temporaryPath.string(), std::ios::trunc);
+        if (!file.is_open())
+            DIE(t("failed_write_cache_index"));
+        file << index.dump(2, ' ');
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, indexPath, error);
+    if (error)
+        DIE(t("failed_write_cache_index") + " (" + error.message() + ")");
+}
+
+void CACHE::evict(nlohmann::json &index, const std::string &keep)
+{
+    const uint64_t limit = static_cast<uint64_t>(std::max(0LL, ARGC::GetIntArg("cache-size", 8192))) * 1024 * 1024;
+    uint64_t total = 0;
+    std::vector<std::pair<int64_t, std::string>> entries;
+    for (auto &[key, entry] : index.items())
+    {
+        total += entry.value("size", uint64_t(0));
+        if (key != keep && servedKeys.count(key) == 0)
+            entries.push_back({entry.value("lastUsed", int64_t(0)), key});
+    }
+    std::sort(entries.begin(), entries.end());
+    for (const auto &[lastUsed, key] : entries)
+    {
+        if (total <= limit)
+            break;
+        IO_DEBUG(t("evicting_cache_entry") + ": " + key);
+        total -= index[key].value("size", uint64_t(0));
+        std::error_code error;
+        std::filesystem::remove(entryPath(key), error);
+        index.erase(key);
+    }
+}
+
+std::string CACHE::copyOut(const std::string &path, const std::string &imageFile)
+{
+    // A block clone costs nothing and only the patched cluster ever gets
+    // its own copy; the entry is still read once to catch corruption.
+    if (MAPPED_FILE::clone(path, imageFile))
+    {
+        IO_DEBUG(t("cloned_cached_image") + ": " + imageFile);
+        return HASH::MD5File(path);
+    }
+    return HASH::MD5CopyFile(path, imageFile);
+}
+
+std::string CACHE::responseKey(const std::string &productUrl, const std::string &version)
+{
+    return productUrl + "@" + version;
+}
+
+bool CACHE::lookupResponse(const std::string &key, long long maxAgeSeconds, nlohmann::json &response)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    const nlohmann::json responses = loadIndex(RESPONSE_INDEX);
+    if (!responses.contains(key) || !responses[key].contains("response"))
+        return false;
+    const long long age = currentTime() - responses[key].value("fetched", 0LL);
+    if (maxAgeSeconds >= 0 && (age < 0 || age > maxAgeSeconds))
+        return false;
+    IO_DEBUG(t("cached_response_age") + ": " + std::to_string(age) + "s");
+    response = responses[key]["response"];
+    return true;
+}
+
+void CACHE::storeResponse(const std::string &key, const nlohmann::json &response)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    nlohmann::json responses = loadIndex(RESPONSE_INDEX);
+    responses[key] = {
+        {"fetched", currentTime()},
+        {"response", response}};
+    saveIndex(RESPONSE_INDEX, responses);
+}
+
+void CACHE::recordServed(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    nlohmann::json responses = loadIndex(RESPONSE_INDEX);
+    if (!responses.contains(key))
+        return;
+    responses[key]["served"] = responses[key].value("served", 0) + 1;
+    responses[key]["lastServed"] = currentTime();
+    saveIndex(RESPONSE_INDEX, responses);
+}
+
+bool CACHE::mostServed(std::string &key, nlohmann::json &response)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    const nlohmann::json responses = loadIndex(RESPONSE_INDEX);
+    std::pair<int, long long> best(0, 0);
+    for (const auto &[candidate, entry] : responses.items())
+    {
+        const std::pair<int, long long> score(entry.value("served", 0), entry.value("lastServed", 0LL));
+        if (score.first > 0 && score > best && entry.contains("response"))
+        {
+            best = score;
+            key = candidate;
+            response = entry["response"];
+        }
+    }
+    return best.first > 0;
+}
+
+void CACHE::prefetch(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::atomic<bool> &cancel)
+{
+    TRACE::SCOPE scope("prefetch");
+    const std::string key = keyFor(url, expected.md5sum);
+    const std::string path = entryPath(key);
+    std::lock_guard<std::mutex> entryLock(entryMutex(key));
+    std::unique_lock<std::mutex> lock(indexMutex);
+    nlohmann::json index = loadIndex(IMAGE_INDEX);
+    const bool cached = index.contains(key) && std::filesystem::exists(path);
+    if (cached && index[key].contains("passwordOffset"))
+        return;
+    lock.unlock();
+
+    if (!cached)
+    {
+        IO::Info(t("prefetching_likely_image"));
+        if (!DOWNLOAD::prefetchFile(url, path, expected, cancel))
+            return;
+    }
+    // Pre-scan too, so a hit skips the search for the password hash.
+    const std::vector<std::pair<size_t, size_t>> positions = HASH::findHashPatterns(path);
+
+    lock.lock();
+    index = loadIndex(IMAGE_INDEX);
+    if (!cached)
+        index[key] = {
+            {"url", url},
+            {"size", std::filesystem::file_size(path)},
+            {"lastUsed", currentTime()}};
+    else if (!index.contains(key))
+        return;
+    if (positions.size() == 1)
+    {
+        index[key]["passwordOffset"] = positions[0].first;
+        index[key]["hashLength"] = positions[0].second;
+    }
+    evict(index, key);
+    saveIndex(IMAGE_INDEX, index);
+    IO_DEBUG(t("prefetch_completed") + ": " + key);
+}
+
+std::string CACHE::hintKey(const std::string &productUrl, const std::string &version, const std::string &md5)
+{
+    return productUrl + "@" + version + "@" + md5.substr(0, HINT_DIGEST_PREFIX);
+}
+
+bool CACHE::lookupPasswordOffset(const std::string &key, const std::string &url, const std::string &md5,
+                                 size_t &offset, size_t &hashLength)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    const nlohmann::json index = loadIndex(IMAGE_INDEX);
+    const std::string imageKey = keyFor(url, md5);
+    if (index.contains(imageKey) && index[imageKey].contains("passwordOffset"))
+    {
+        offset = index[imageKey]["passwordOffset"];
+        hashLength = index[imageKey]["hashLength"];
+        return true;
+    }
+    const nlohmann::json hints = loadIndex(HINT_INDEX);
+    if (!hints.contains(key))
+        return false;
+    offset = hints[key].value("passwordOffset", size_t(0));
+    hashLength = hints[key].value("hashLength", size_t(0));
+    IO_DEBUG(t("using_learned_password_offset") + ": " + key);
+    return true;
+}
+
+void CACHE::recordPasswordOffset(const std::string &key, size_t offset, size_t hashLength)
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    nlohmann::json hints = loadIndex(HINT_INDEX);
+    if (hints.contains(key) && hints[key].value("passwordOffset", size_t(0)) == offset &&
+        hints[key].value("hashLength", size_t(0)) == hashLength)
+        return;
+    hints[key] = {
+        {"passwordOffset", offset},
+        {"hashLength", hashLength},
+        {"learned", currentTime()}};
+    saveIndex(HINT_INDEX, hints);
+}
+
+void CACHE::prepareImage(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::string &imageFile,
+                         const DOWNLOAD::PREFIX_CALLBACK &onPrefix)
+{
+    TRACE::SCOPE scope("prepare image");
+    // The consumer sees the image in order, exactly once; whatever could
+    // not be streamed is handed over in one piece at the end.
+    size_t delivered = 0;
+    size_t imageSize = 0;
+    auto track = [&](unsigned char *data, size_t available, size_t size)
+    {
+        delivered = available;
+        imageSize = size;
+        onPrefix(data, available, size);
+    };
+    auto deliverRest = [&]()
+    {
+        if (!onPrefix || (imageSize > 0 && delivered == imageSize))
+            return;
+        MAPPED_FILE image(imageFile, MAPPED_FILE::WRITE);
+        onPrefix(image.data(), image.size(), image.size());
+    };
+
+    // While streaming, verified bytes are copied out of the downloaded file
+    // as they arrive: the consumer patches its copy, and the file the
+    // download journal vouches for stays pristine.
+    std::unique_ptr<MAPPED_FILE> image;
+    size_t copied = 0;
+    DOWNLOAD::PREFIX_CALLBACK copyThrough = nullptr;
+    if (onPrefix)
+        copyThrough = [&](unsigned char *data, size_t available, size_t size)
+        {
+            if (!image)
+                image.reset(new MAPPED_FILE(imageFile, size));
+            std::memcpy(image->data() + copied, data + copied, available - copied);
+            copied = available;
+            track(image->data(), available, size);
+        };
+
+    if (ARGC::HasArg("no-cache"))
+    {
+        if (!onPrefix)
+        {
+            DOWNLOAD::downloadFile(url, imageFile, expected);
+            return;
+        }
+        // The pristine download lives next to the image only until it is
+        // complete; a partial one is resumed from its journal.
+        const std::string pristineFile = imageFile + ".download";
+        DOWNLOAD::downloadFile(url, pristineFile, expected, copyThrough);
+        const bool streamed = image && copied == image->size();
+        image.reset();
+        if (!streamed)
+            HASH::MD5CopyFile(pristineFile, imageFile);
+        std::error_code error;
+        std::filesystem::remove(pristineFile, error);
+        deliverRest();
+        return;
+    }
+
+    const std::string key = keyFor(url, expected.md5sum);
+    const std::string path = entryPath(key);
+    const bool verifiable = key.substr(0, 4) != "url-";
+    const long long now = currentTime();
+    IO_DEBUG(t("cache_key") + ": " + key);
+
+    std::lock_guard<std::mutex> entryLock(entryMutex(key));
+    std::unique_lock<std::mutex> lock(indexMutex);
+    nlohmann::json index = loadIndex(IMAGE_INDEX);
+    if (index.contains(key) && std::filesystem::exists(path) &&
+        std::filesystem::file_size(path) == index[key].value("size", uint64_t(0)))
+    {
+        lock.unlock();
+        IO::Info(t("using_cached_image"));
+        const std::string copiedMd5 = copyOut(path, imageFile);
+        lock.lock();
+        index = loadIndex(IMAGE_INDEX);
+        if (!verifiable || copiedMd5 == key)
+        {
+            index[key]["lastUsed"] = now;
+            saveIndex(IMAGE_INDEX, index);
+            lock.unlock();
+            deliverRest();
+            return;
+        }
+        IO::Warn(t("cached_image_corrupted"));
+        index.erase(key);
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        saveIndex(IMAGE_INDEX, index);
+    }
+    else if (!std::filesystem::exists(path + ".journal"))
+    {
+        // Neither indexed nor resumable: a leftover from an interrupted store.
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    lock.unlock();
+
+    DOWNLOAD::downloadFile(url, path, expected, copyThrough);
+    const bool streamed = image && copied == image->size();
+    image.reset();
+    if (!streamed)
+    {
+        IO::Info(t("verifying_downloaded_image"));
+        const std::string copiedMd5 = copyOut(path, imageFile);
+        if (verifiable && copiedMd5 != key)
+        {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            DIE(t("downloaded_image_md5_mismatch") + ": " + copiedMd5 + " != " + key);
+        }
+    }
+
+    lock.lock();
+    index = loadIndex(IMAGE_INDEX);
+    index[key] = {
+        {"url", url},
+        {"size", std::filesystem::file_size(path)},
+        {"lastUsed", now}};
+    evict(index, key);
+    saveIndex(IMAGE_INDEX, index);
+    lock.unlock();
+    deliverRest();
+}
+
+std::string CACHE::locateImage(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::string &imageFile)
+{
+    TRACE::SCOPE scope("locate image");
+    if (ARGC::HasArg("no-cache"))
+    {
+        DOWNLOAD::downloadFile(url, imageFile, expected);
+        return imageFile;
+    }
+
+    const std::string key = keyFor(url, expected.md5sum);
+    const std::string path = entryPath(key);
+    const long long now = currentTime();
+    IO_DEBUG(t("cache_key") + ": " + key);
+
+    std::lock_guard<std::mutex> entryLock(entryMutex(key));
+    std::unique_lock<std::mutex> lock(indexMutex);
+    servedKeys.insert(key);
+    nlohmann::json index = loadIndex(IMAGE_INDEX);
+    if (index.contains(key) && std::filesystem::exists(path) &&
+        std::filesystem::file_size(path) == index[key].value("size", uint64_t(0)))
+    {
+        // Served bytes are digested anyway, so a corrupted entry is caught
+        // there instead of by reading it twice here.
+        IO::Info(t("using_cached_image"));
+        index[key]["lastUsed"] = now;
+        saveIndex(IMAGE_INDEX, index);
+        return path;
+    }
+    if (!std::filesystem::exists(path + ".journal"))
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    lock.unlock();
+
+    DOWNLOAD::downloadFile(url, path, expected);
+
+    lock.lock();
+    index = loadIndex(IMAGE_INDEX);
+    index[key] = {
+        {"url", url},
+        {"size", std::filesystem::file_size(path)},
+        {"lastUsed", now}};
+    evict(index, key);
+    saveIndex(IMAGE_INDEX, index);
+    return path;
+}
+
+void CACHE::invalidate(const std::string &url, const std::string &md5)
+{
+    const std::string key = keyFor(url, md5);
+    std::lock_guard<std::mutex> lock(indexMutex);
+    nlohmann::json index = loadIndex(IMAGE_INDEX);
+    index.erase(key);
+    saveIndex(IMAGE_INDEX, index);
+    std::error_code error;
+    std::filesystem::remove(entryPath(key), error);
+}
@@ -0,0 +1,84 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <set>
+#include "json.hpp"
+#include "download.hpp"
+
+// Pristine firmware images keyed by the server-provided MD5 (or the URL when
+// the server gives none). Entries are verified when stored and re-verified
+// while being copied out or served, and the least recently used ones are
+// evicted once the cache grows past --cache-size. checkVersion responses
+// live next to them in their own index, as do the password offsets learned
+// for each product, version and image.
+class CACHE
+{
+private:
+    static constexpr const char *IMAGE_INDEX = "index.json";
+    static constexpr const char *RESPONSE_INDEX = "responses.json";
+    static constexpr const char *HINT_INDEX = "hints.json";
+    // Enough of the image MD5 to tell builds of one version apart.
+    static constexpr size_t HINT_DIGEST_PREFIX = 8;
+    static std::mutex indexMutex;
+    // Held while an entry is downloaded, so jobs wanting the same image wait
+    // for one download instead of racing on its file and journal.
+    static std::mutex &entryMutex(const std::string &key);
+    // Entries handed out by locateImage are served in place; evicting one
+    // would pull the file from under a running session.
+    static std::set<std::string> servedKeys;
+
+    static std::string directory();
+    static long long currentTime();
+    static std::string keyFor(const std::string &url, const std::string &md5);
+    static std::string entryPath(const std::string &key);
+    static nlohmann::json loadIndex(const std::string &name);
+    static void saveIndex(const std::string &name, const nlohmann::json &index);
+    static void evict(nlohmann::json &index, const std::string &keep);
+    // Copies an entry out, returning the MD5 of what was copied.
+    static std::string copyOut(const std::string &path, const std::string &imageFile);
+
+public:
+    // checkVersion answers keyed by product URL and reported version.
+    // A negative maxAgeSeconds accepts an entry of any age.
+    static std::string responseKey(const std::string &productUrl, const std::string &version);
+    static bool lookupResponse(const std::string &key, long long maxAgeSeconds, nlohmann::json &response);
+    static void storeResponse(const std::string &key, const nlohmann::json &response);
+    // Served counts pick the image worth prefetching while capture waits.
+    static void recordServed(const std::string &key);
+    static bool mostServed(std::string &key, nlohmann::json &response);
+    static void prefetch(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::atomic<bool> &cancel);
+    // Where the password hash was last found in an image, from the
+    // prefetch pre-scan or from an earlier run on the same firmware. Only
+    // a hint: HASH::locatePassword checks it before trusting it.
+    static std::string hintKey(const std::string &productUrl, const std::string &version, const std::string &md5);
+    static bool lookupPasswordOffset(const std::string &key, const std::string &url, const std::string &md5,
+                                     size_t &offset, size_t &hashLength);
+    static void recordPasswordOffset(const std::string &key, size_t offset, size_t hashLength);
+    // onPrefix, when given, receives imageFile as it becomes available.
+    static void prepareImage(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::string &imageFile,
+                             const DOWNLOAD::PREFIX_CALLBACK &onPrefix = nullptr);
+    // Path of a pristine copy of the image to be served in place, without
+    // copying it out: the cache entry itself, or imageFile with --no-cache.
+    static std::string locateImage(const std::string &url, const DOWNLOAD::EXPECTED_HASHES &expected, const std::string &imageFile);
+    // Drops an entry found corrupted while it was being served.
+    static void invalidate(const std::string &url, const std::string &md5);
+};
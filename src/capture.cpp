@@ -19,101 +19,323 @@
 #include "capture.hpp"
 #include "io.hpp"
 #include "i18n.hpp"
+#include "argc.hpp"
+#include "trace.hpp"
 #include <ntddndis.h>
+#include <conio.h>
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <cstring>
 
-CAPTURE::CAPTURE_RESULT *CAPTURE::global_capture_result = nullptr;
-pcap_t *CAPTURE::global_pcap_handle = nullptr;
+CAPTURE::MATCH_CALLBACK CAPTURE::global_on_match;
+bool CAPTURE::global_interactive = true;
+std::vector<pcap_t *> CAPTURE::global_pcap_handles;
+std::unique_ptr<RING_BUFFER<CAPTURE::PACKET>> CAPTURE::global_packet_ring = nullptr;
+std::atomic<bool> CAPTURE::global_consumer_running(false);
+std::atomic<size_t> CAPTURE::global_truncated_packets(0);
+std::vector<PACKET_PARSER::PARSE_FUNCTION> CAPTURE::global_packet_parsers;
+bool CAPTURE::global_replay = false;
+CAPTURE::STATISTICS CAPTURE::global_statistics;
+const int CAPTURE::STATISTICS::LATENCY_BUCKET_COUNT;
+const uint64_t CAPTURE::STATISTICS::LATENCY_BOUNDS_US[LATENCY_BUCKET_COUNT - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 1000000};
+const int CAPTURE::SNAPSHOT_LENGTH;
+const int CAPTURE::PACKET_SLOT_SIZE;
+const int CAPTURE::KERNEL_STATISTICS_INTERVAL_MS;
+const uint32_t CAPTURE::DEFAULT_NETMASK;
+const long long CAPTURE::MAX_CAPTURE_BUFFER_MIB;
+const long long CAPTURE::MAX_CAPTURE_TIMEOUT_MS;
 
-void CAPTURE::packet_handler(u_char *param, const struct pcap_pkthdr *header, const u_char *pkt_data)
+void CAPTURE::STATISTICS::observeLatency(double latencyMs)
+{
+    const double latencyUs = latencyMs * 1000.0;
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKET_COUNT - 1 && latencyUs > LATENCY_BOUNDS_US[bucket])
+        bucket++;
+    latencyBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CAPTURE::STATISTICS::reset()
+{
+    received = processed = matched = 0;
+    for (auto &rejection : rejections)
+        rejection = 0;
+    for (auto &bucket : latencyBuckets)
+        bucket = 0;
+    kernelReceived = kernelDropped = interfaceDropped = 0;
+}
+
+const CAPTURE::STATISTICS &CAPTURE::getStatistics() { return global_statistics; }
+
+void CAPTURE::updateKernelStatistics(pcap_t *handle, struct pcap_stat &previous)
+{
+    // pcap_stats is only safe on the thread reading the handle, so each
+    // capture thread adds what its own handle counted since last time.
+    struct pcap_stat kernelStatistics;
+    if (pcap_stats(handle, &kernelStatistics) != 0)
+        return;
+    global_statistics.kernelReceived.fetch_add(kernelStatistics.ps_recv - previous.ps_recv, std::memory_order_relaxed);
+    global_statistics.kernelDropped.fetch_add(kernelStatistics.ps_drop - previous.ps_drop, std::memory_order_relaxed);
+    global_statistics.interfaceDropped.fetch_add(kernelStatistics.ps_ifdrop - previous.ps_ifdrop, std::memory_order_relaxed);
+    previous = kernelStatistics;
+}
+
+void CAPTURE::captureHandle(size_t index)
 {
-    IO::Debug(t("packet_received") + ": " + std::to_string(header->len));
-    if (CAPTURE::IsWantedRequest(pkt_data, header->len, *CAPTURE::global_capture_result))
+    pcap_t *handle = global_pcap_handles[index];
+    struct pcap_stat previous = {};
+    auto lastKernelUpdate = std::chrono::steady_clock::now();
+    while (true)
     {
-        IO::Debug(t("target_packet_found"));
-        pcap_breakloop(CAPTURE::global_pcap_handle);
+        // Returns at least every read timeout, even with nothing captured.
+        const int dispatched = pcap_dispatch(handle, -1, packet_handler, reinterpret_cast<u_char *>(index));
+        if (dispatched < 0 || (dispatched == 0 && global_replay))
+            break;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastKernelUpdate >= std::chrono::milliseconds(KERNEL_STATISTICS_INTERVAL_MS))
+        {
+            updateKernelStatistics(handle, previous);
+            lastKernelUpdate = now;
+        }
     }
+    updateKernelStatistics(handle, previous);
 }
 
-bool CAPTURE::IsWantedRequest_NetworkLayer(const u_char **buf, int &len)
+void CAPTURE::printStatistics()
 {
-    if (len < sizeof(eth_header) + sizeof(ip_header))
+    static const char *const rejectionKeys[REJECTION_COUNT] = {
+        "stats_rejected_truncated", "stats_rejected_non_ip", "stats_rejected_non_tcp",
+        "stats_rejected_invalid_tcp", "stats_rejected_wrong_port", "stats_rejected_empty_payload",
+        "stats_rejected_no_match"};
+    const STATISTICS &stats = global_statistics;
+    IO::Info(t("capture_statistics") + ":");
+    IO::Info("  " + t("stats_received") + ": " + std::to_string(stats.received.load()) +
+             ", " + t("stats_processed") + ": " + std::to_string(stats.processed.load()) +
+             ", " + t("stats_matched") + ": " + std::to_string(stats.matched.load()));
+    IO::Info("  " + t("stats_kernel") + ": " + t("stats_received") + " " + std::to_string(stats.kernelReceived.load()) +
+             ", " + t("stats_dropped") + " " + std::to_string(stats.kernelDropped.load()) +
+             ", " + t("stats_if_dropped") + " " + std::to_string(stats.interfaceDropped.load()));
+    if (global_packet_ring)
+        IO::Info("  " + t("stats_ring") + ": " + std::to_string(global_packet_ring->getOccupancy()) + "/" +
+                 std::to_string(global_packet_ring->getCapacity()) + ", " + t("stats_dropped") + " " +
+                 std::to_string(global_packet_ring->getOverflows()));
+    for (int reason = 0; reason < REJECTION_COUNT; reason++)
+        IO::Info("  " + t(rejectionKeys[reason]) + ": " + std::to_string(stats.rejections[reason].load()));
+    std::string histogram;
+    for (int bucket = 0; bucket < STATISTICS::LATENCY_BUCKET_COUNT; bucket++)
     {
-        IO::Debug(t("packet_too_small_network"));
-        return false;
+        histogram += (bucket < STATISTICS::LATENCY_BUCKET_COUNT - 1
+                          ? "<=" + std::to_string(STATISTICS::LATENCY_BOUNDS_US[bucket]) + "us"
+                          : std::string("+Inf")) +
+                     ":" + std::to_string(stats.latencyBuckets[bucket].load()) + " ";
     }
-    const eth_header *eh = (const eth_header *)*buf;
-    if (ntohs(eh->ether_type) != 0x0800)
+    IO::Info("  " + t("stats_latency_histogram") + ": " + histogram);
+}
+
+void CAPTURE::monitorCapture()
+{
+    const long long intervalSeconds = ARGC::GetIntArg("capture-stats", 0);
+    auto lastReport = std::chrono::steady_clock::now();
+    while (global_consumer_running.load(std::memory_order_acquire))
     {
-        IO::Debug(t("non_ipv4_packet"));
-        return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto now = std::chrono::steady_clock::now();
+        if (global_interactive && _kbhit() && std::tolower(_getch()) == 's')
+            printStatistics();
+        else if (intervalSeconds > 0 && now - lastReport >= std::chrono::seconds(intervalSeconds))
+        {
+            printStatistics();
+            lastReport = now;
+        }
     }
-    *buf += sizeof(eth_header);
-    len -= sizeof(eth_header);
-    const ip_header *ih = (const ip_header *)*buf;
-    if ((ih->ip_hl_v & 0xF0) != 0x40)
+}
+
+void CAPTURE::packet_handler(u_char *param, const struct pcap_pkthdr *header, const u_char *pkt_data)
+{
+    global_statistics.received.fetch_add(1, std::memory_order_relaxed);
+    const uint32_t length = std::min<uint32_t>(header->caplen, PACKET_SLOT_SIZE);
+    // Cut by the snapshot length or the slot, the payload would parse as a
+    // shorter request than the one on the wire.
+    const bool truncated = length < header->len;
+    if (truncated)
+        global_truncated_packets.fetch_add(1, std::memory_order_relaxed);
+    // A savefile can always wait for the consumer, so replay never drops.
+    while (global_replay && global_packet_ring->getOccupancy() >= global_packet_ring->getCapacity())
+        std::this_thread::yield();
+    const uint32_t source = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(param));
+    global_packet_ring->tryPush(
+        [header, pkt_data, length, source, truncated](PACKET &packet)
+        {
+            packet.timestamp = header->ts;
+            packet.length = length;
+            packet.source = source;
+            packet.truncated = truncated;
+            std::memcpy(packet.data, pkt_data, length);
+        });
+}
+
+void CAPTURE::consumePackets()
+{
+    size_t idleRounds = 0;
+    while (true)
     {
-        IO::Debug(t("non_ipv4_packet_header"));
-        return false;
+        bool stopRequested = false;
+        const bool popped = global_packet_ring->tryPop(
+            [&stopRequested](PACKET &packet)
+            {
+                IO_DEBUG(t("packet_received") + ": " + std::to_string(packet.length));
+                global_statistics.processed.fetch_add(1, std::memory_order_relaxed);
+                CAPTURE_RESULT candidate;
+                if (packet.truncated)
+                    global_statistics.reject(REJECTED_TRUNCATED);
+                const bool matched = !packet.truncated &&
+                                     CAPTURE::IsWantedRequest(packet.data, packet.length, global_packet_parsers[packet.source], candidate);
+                if (matched)
+                {
+                    // Only recognised requests are timed; rejected traffic
+                    // says nothing about how fast a pen is answered.
+                    const double latencyMs = global_replay ? 0 : latencySince(packet.timestamp);
+                    if (!global_replay)
+                        global_statistics.observeLatency(latencyMs);
+                    if (global_statistics.matched.fetch_add(1, std::memory_order_relaxed) == 0)
+                        IO_DEBUG(t("target_packet_found"));
+                    candidate.captureLatencyMs = latencyMs;
+                    stopRequested = !global_on_match(candidate);
+                }
+            });
+        if (stopRequested && !global_replay)
+        {
+            stop();
+            return;
+        }
+        if (popped)
+            idleRounds = 0;
+        else if (!global_consumer_running.load(std::memory_order_acquire))
+            return;
+        else if (++idleRounds < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    if ((ih->ip_p) != IPPROTO_TCP)
+}
+
+double CAPTURE::latencySince(const struct timeval &timestamp)
+{
+    const auto captured = std::chrono::system_clock::time_point(
+        std::chrono::seconds(timestamp.tv_sec) + std::chrono::microseconds(timestamp.tv_usec));
+    return std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - captured).count();
+}
+
+long long CAPTURE::boundedArgument(const std::string &key, long long defaultValue, long long maximum)
+{
+    const long long value = ARGC::GetIntArg(key, defaultValue);
+    if (value <= 0)
+        DIE(t("capture_argument_not_positive") + ": --" + key + "=" + std::to_string(value));
+    if (value > maximum)
     {
-        IO::Debug(t("non_tcp_packet"));
-        return false;
+        IO::Warn(t("capture_argument_clamped") + ": --" + key + "=" + std::to_string(maximum));
+        return maximum;
     }
-    const size_t deltaLen = (ih->ip_hl_v & 0x0F) * 4;
-    *buf += deltaLen;
-    len -= deltaLen;
-    IO::Debug(t("network_layer_passed"));
-    return true;
+    return value;
 }
-bool CAPTURE::IsWantedRequest_TransportLayer(const u_char **buf, int &len)
+
+pcap_t *CAPTURE::openHandle(const char *deviceName)
 {
-    if (len < sizeof(tcp_header))
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_create(deviceName, errbuf);
+    if (handle == NULL)
+        DIE(t("unable_open_adapter") + ": " + errbuf);
+
+    const long long bufferMiB = boundedArgument("capture-buffer", 16, MAX_CAPTURE_BUFFER_MIB);
+    const long long timeoutMs = ARGC::HasArg("capture-timeout") ? boundedArgument("capture-timeout", 0, MAX_CAPTURE_TIMEOUT_MS) : 0;
+    IO_DEBUG(t("capture_buffer_size") + ": " + std::to_string(bufferMiB) + " MiB");
+    pcap_set_snaplen(handle, SNAPSHOT_LENGTH);
+    pcap_set_promisc(handle, 1);
+    pcap_set_buffer_size(handle, static_cast<int>(bufferMiB * 1024 * 1024));
+    if (timeoutMs > 0)
     {
-        IO::Debug(t("packet_too_small_transport"));
-        return false;
+        IO_DEBUG(t("capture_read_timeout") + ": " + std::to_string(timeoutMs) + " ms");
+        pcap_set_timeout(handle, static_cast<int>(timeoutMs));
     }
-    const tcp_header *th = (const tcp_header *)*buf;
-    if ((th->th_offx2 & 0xF0) == 0)
+    else
     {
-        IO::Debug(t("invalid_tcp_header"));
-        return false;
+        // The timeout still bounds each read, so the capture thread gets
+        // to collect its kernel statistics while the link is quiet.
+        IO_DEBUG(t("capture_immediate_mode"));
+        pcap_set_immediate_mode(handle, 1);
+        pcap_set_timeout(handle, KERNEL_STATISTICS_INTERVAL_MS);
     }
-    if (ntohs(th->th_sport) != 80 && ntohs(th->th_dport) != 80)
+
+    const int status = pcap_activate(handle);
+    if (status < 0)
     {
-        IO::Debug(t("non_http_port") + "=" + std::to_string(ntohs(th->th_sport)) + " " + t("dst") + "=" + std::to_string(ntohs(th->th_dport)));
-        return false;
+        const std::string error = pcap_geterr(handle);
+        pcap_close(handle);
+        DIE(t("unable_open_adapter") + ": " + pcap_statustostr(status) + " " + error);
     }
-    const size_t deltaLen = ((th->th_offx2 & 0xF0) >> 4) * 4;
-    *buf += deltaLen;
-    len -= deltaLen;
-    IO::Debug(t("transport_layer_passed") + ": " + std::to_string(len) + " " + t("bytes"));
-    return true;
+    if (status > 0)
+        IO::Warn(t("capture_activate_warning") + ": " + pcap_statustostr(status) + " " + pcap_geterr(handle));
+    return handle;
 }
-bool CAPTURE::IsWantedRequest(const u_char *pkt_data, int data_len, CAPTURE_RESULT &result)
+
+void CAPTURE::stop()
+{
+    global_consumer_running.store(false, std::memory_order_release);
+    breakAllLoops();
+}
+
+void CAPTURE::breakAllLoops()
+{
+    for (pcap_t *handle : global_pcap_handles)
+        pcap_breakloop(handle);
+}
+
+bool CAPTURE::IsWantedRequest(const u_char *pkt_data, int data_len, PACKET_PARSER::PARSE_FUNCTION parser, CAPTURE_RESULT &result)
 {
-    IO::Debug(t("analyzing_packet") + " " + std::to_string(data_len) + " " + t("bytes"));
-    if (!IsWantedRequest_NetworkLayer(&pkt_data, data_len) ||
-        !IsWantedRequest_TransportLayer(&pkt_data, data_len) ||
-        !data_len)
+    static const char *const verdictKeys[] = {
+        "", "packet_truncated", "non_ip_packet", "non_tcp_packet", "invalid_tcp_header"};
+    static const REJECTION verdictRejections[] = {
+        REJECTION_COUNT, REJECTED_TRUNCATED, REJECTED_NON_IP, REJECTED_NON_TCP, REJECTED_INVALID_TCP_HEADER};
+
+    IO_DEBUG(t("analyzing_packet") + " " + std::to_string(data_len) + " " + t("bytes"));
+    PACKET_PARSER::SEGMENT segment;
+    const PACKET_PARSER::VERDICT verdict = parser(pkt_data, data_len, segment);
+    if (verdict != PACKET_PARSER::ACCEPTED)
+    {
+        IO_DEBUG(t(verdictKeys[verdict]));
+        IO_DEBUG(t("packet_rejected"));
+        global_statistics.reject(verdictRejections[verdict]);
+        return false;
+    }
+    if (segment.sourcePort != 80 && segment.destinationPort != 80)
+    {
+        IO_DEBUG(t("non_http_port") + "=" + std::to_string(segment.sourcePort) + " " + t("dst") + "=" + std::to_string(segment.destinationPort));
+        IO_DEBUG(t("packet_rejected"));
+        global_statistics.reject(REJECTED_WRONG_PORT);
+        return false;
+    }
+    IO_DEBUG(t("transport_layer_passed") + ": " + std::to_string(segment.length) + " " + t("bytes"));
+    if (segment.length == 0)
     {
-        IO::Debug(t("packet_rejected"));
+        IO_DEBUG(t("packet_rejected"));
+        global_statistics.reject(REJECTED_EMPTY_PAYLOAD);
         return false;
     }
 
-    const std::string payload((char *)pkt_data, data_len);
+    const std::string payload((const char *)segment.payload, segment.length);
     std::smatch matches;
     const std::regex pattern(R"(^POST (/product/[0-9]+/[0-9a-f]+/ota/checkVersion) HTTP/[0-9.]+\r\n([^\r\n]*\r\n)*\r\n(.*)$)");
-    IO::Debug(t("http_payload_preview") + ": " + payload.substr(0, std::min(200, (int)payload.length())));
+    IO_DEBUG(t("http_payload_preview") + ": " + payload.substr(0, std::min(200, (int)payload.length())));
     if (std::regex_search(payload, matches, pattern))
     {
-        IO::Debug(t("ota_request_matched"));
+        IO_DEBUG(t("ota_request_matched"));
         result.productUrl = matches[1].str();
-        IO::Debug(t("product_url") + ": " + result.productUrl);
+        IO_DEBUG(t("product_url") + ": " + result.productUrl);
         try
         {
             result.request_body = nlohmann::json::parse(matches[3].str());
-            IO::Debug(t("json_body_parsed"));
+            IO_DEBUG(t("json_body_parsed"));
         }
         catch (const nlohmann::json::parse_error &e)
         {
@@ -121,80 +343,183 @@ bool CAPTURE::IsWantedRequest(const u_char *pkt_data, int data_len, CAPTURE_RESU
         }
         return true;
     }
-    IO::Debug(t("ota_request_not_matched"));
+    IO_DEBUG(t("ota_request_not_matched"));
+    global_statistics.reject(REJECTED_NO_MATCH);
     return false;
 }
 
-void CAPTURE::capture(CAPTURE_RESULT &result)
+pcap_t *CAPTURE::openReplay(const std::string &filename)
 {
-    IO::Debug(t("initializing_capture"));
     char errbuf[PCAP_ERRBUF_SIZE];
-    global_capture_result = &result;
-    global_pcap_handle = nullptr;
+    IO::Info(t("replaying_capture_file") + ": " + filename);
+    pcap_t *handle = pcap_open_offline(filename.c_str(), errbuf);
+    if (handle == NULL)
+        DIE(t("unable_open_capture_file") + ": " + errbuf);
+    return handle;
+}
+
+uint32_t CAPTURE::parseIPv4Argument(const std::string &key, const std::string &defaultValue)
+{
+    const std::string value = ARGC::GetArg(key, defaultValue);
+    struct in_addr address;
+    if (inet_pton(AF_INET, value.c_str(), &address) != 1)
+        DIE(t("invalid_ipv4_argument") + ": --" + key + "=" + value);
+    return address.s_addr;
+}
+
+void CAPTURE::openInterfaces(std::vector<pcap_t *> &handles, std::vector<u_int> &netmasks)
+{
+    // Without an explicit mask every adapter is judged by its own subnet,
+    // so all adapters sharing the hotspot's subnet are opened.
+    const uint32_t wantedAddress = parseIPv4Argument("capture-address", "192.168.137.1");
+    const bool explicitNetmask = ARGC::HasArg("capture-netmask");
+    const uint32_t wantedNetmask = explicitNetmask ? parseIPv4Argument("capture-netmask", "") : 0;
 
-    IO::Debug(t("finding_devices"));
+    char errbuf[PCAP_ERRBUF_SIZE];
+    IO_DEBUG(t("finding_devices"));
     pcap_if_t *devices;
     if (pcap_findalldevs(&devices, errbuf) == -1)
         DIE(t("error_finding_devices") + ": " + std::string(errbuf));
 
-    IO::Debug(t("searching_hotspot"));
-    pcap_if_t *selectedDevice = nullptr;
-    for (pcap_if_t *device = devices; device && !selectedDevice; device = device->next)
+    IO_DEBUG(t("searching_hotspot"));
+    for (pcap_if_t *device = devices; device; device = device->next)
     {
-        IO::Debug(t("checking_device") + ": " + std::string(device->name));
-        for (pcap_addr_t *addr = device->addresses; addr && !selectedDevice; addr = addr->next)
+        IO_DEBUG(t("checking_device") + ": " + std::string(device->name));
+        for (pcap_addr_t *addr = device->addresses; addr; addr = addr->next)
         {
-            if (addr->addr && addr->addr->sa_family == AF_INET &&
-                ((struct sockaddr_in *)addr->addr)->sin_addr.s_addr ==
-                    htonl((192 << 24) | (168 << 16) | (137 << 8) | 1))
+            if (!addr->addr || addr->addr->sa_family != AF_INET)
+                continue;
+            const uint32_t interfaceNetmask = addr->netmask != NULL ? ((struct sockaddr_in *)addr->netmask)->sin_addr.S_un.S_addr
+                                                                    : DEFAULT_NETMASK;
+            const uint32_t netmask = explicitNetmask ? wantedNetmask : interfaceNetmask;
+            if ((((struct sockaddr_in *)addr->addr)->sin_addr.s_addr & netmask) == (wantedAddress & netmask))
             {
-                IO::Debug(t("found_target_interface") + ": " + std::string(device->name));
-                selectedDevice = device;
+                IO_DEBUG(t("found_target_interface") + ": " + std::string(device->name));
+                IO_DEBUG(t("opening_capture_handle") + ": " + std::string(device->name));
+                handles.push_back(openHandle(device->name));
+                netmasks.push_back(interfaceNetmask);
+                break;
             }
         }
     }
-    if (!selectedDevice)
+    pcap_freealldevs(devices);
+    if (handles.empty())
         DIE(t("no_interface_found"));
+    IO::Info(t("capturing_on_interfaces") + ": " + std::to_string(handles.size()));
+}
 
-    IO::Debug(t("opening_capture_handle") + ": " + std::string(selectedDevice->name));
-    pcap_t *packetCaptureHandle = pcap_open_live(selectedDevice->name, 65536, PCAP_OPENFLAG_PROMISCUOUS, 1000, errbuf);
-    if (packetCaptureHandle == NULL)
-        DIE(t("unable_open_adapter") + ": " + errbuf);
-    global_pcap_handle = packetCaptureHandle;
-    IO::Debug(t("checking_datalink"));
-    if (pcap_datalink(packetCaptureHandle) != DLT_EN10MB)
-        IO::Warn(t("non_ethernet_link"));
-
-    IO::Debug(t("setting_packet_filter"));
-    u_int netmask;
-    if (selectedDevice->addresses != NULL && selectedDevice->addresses->netmask != NULL)
-        netmask = ((struct sockaddr_in *)(selectedDevice->addresses->netmask))->sin_addr.S_un.S_addr;
-    else
-        netmask = 0xffffff;
+void CAPTURE::prepareHandle(pcap_t *handle, u_int netmask)
+{
+    IO_DEBUG(t("checking_datalink"));
+    const int linkType = pcap_datalink(handle);
+    const PACKET_PARSER::PARSE_FUNCTION parser = PACKET_PARSER::select(linkType);
+    if (!parser)
+    {
+        const char *linkName = pcap_datalink_val_to_name(linkType);
+        DIE(t("unsupported_datalink") + ": " + (linkName ? linkName : std::to_string(linkType)));
+    }
+    IO_DEBUG(t("datalink_parser_selected") + ": " + pcap_datalink_val_to_name(linkType));
+    global_packet_parsers.push_back(parser);
 
+    IO_DEBUG(t("setting_packet_filter"));
     struct bpf_program fcode;
     std::string pcap_filter_string = "tcp port 80";
-    IO::Debug(t("compiling_filter") + ": " + pcap_filter_string);
-    if (pcap_compile(packetCaptureHandle, &fcode, pcap_filter_string.c_str(), 1, netmask) < 0)
+    IO_DEBUG(t("compiling_filter") + ": " + pcap_filter_string);
+    if (pcap_compile(handle, &fcode, pcap_filter_string.c_str(), 1, netmask) < 0)
+        DIE(t("unable_compile_filter") + ": " + std::string(pcap_geterr(handle)));
+    IO_DEBUG(t("setting_filter"));
+    if (pcap_setfilter(handle, &fcode) < 0)
+        DIE(t("error_setting_filter") + ": " + std::string(pcap_geterr(handle)));
+    pcap_freecode(&fcode);
+}
+
+void CAPTURE::capture(CAPTURE_RESULT &result)
+{
+    // Only the first match counts; a replay still runs to the end for the
+    // statistics.
+    global_on_match = [&result](CAPTURE_RESULT &candidate)
     {
-        pcap_close(packetCaptureHandle);
-        pcap_freealldevs(devices);
-        DIE(t("unable_compile_filter") + ": " + std::string(pcap_geterr(packetCaptureHandle)));
-    }
-    IO::Debug(t("setting_filter"));
-    if (pcap_setfilter(packetCaptureHandle, &fcode) < 0)
+        if (result.productUrl.empty())
+            result = std::move(candidate);
+        return false;
+    };
+    runCapture(true);
+    if (global_statistics.matched.load() == 0)
+        DIE(t("no_request_captured"));
+    IO::Info(t("captured_update_request") + ": " + result.productUrl);
+    if (!global_replay)
+        IO::Info(t("capture_latency") + ": " + std::to_string(result.captureLatencyMs) + " ms");
+}
+
+void CAPTURE::captureEach(const MATCH_CALLBACK &onMatch)
+{
+    global_on_match = onMatch;
+    runCapture(false);
+}
+
+void CAPTURE::runCapture(bool interactive)
+{
+    TRACE::SCOPE scope("capture");
+    IO_DEBUG(t("initializing_capture"));
+    global_interactive = interactive;
+    global_pcap_handles.clear();
+    global_packet_parsers.clear();
+
+    const std::string replayFile = ARGC::GetArg("replay");
+    global_replay = !replayFile.empty();
+    std::vector<u_int> netmasks;
+    if (global_replay)
     {
-        pcap_close(packetCaptureHandle);
-        pcap_freealldevs(devices);
-        DIE(t("error_setting_filter") + ": " + std::string(pcap_geterr(packetCaptureHandle)));
+        global_pcap_handles.push_back(openReplay(replayFile));
+        netmasks.push_back(PCAP_NETMASK_UNKNOWN);
     }
+    else
+        openInterfaces(global_pcap_handles, netmasks);
+    for (size_t i = 0; i < global_pcap_handles.size(); i++)
+        prepareHandle(global_pcap_handles[i], netmasks[i]);
 
-    IO::Warn(t("waiting_update_packets"));
-    IO::Debug(t("starting_capture_loop"));
+    if (!global_replay)
+        IO::Warn(t("waiting_update_packets"));
+    IO_DEBUG(t("starting_capture_loop"));
 
-    pcap_freealldevs(devices);
-    pcap_loop(packetCaptureHandle, -1, packet_handler, NULL);
-    IO::Info(t("captured_update_request") + ": " + result.productUrl);
-    IO::Debug(t("closing_capture_handle"));
-    pcap_close(packetCaptureHandle);
+    const long long ringSlots = ARGC::GetIntArg("capture-ring", 1024);
+    global_packet_ring = std::make_unique<RING_BUFFER<PACKET>>(static_cast<size_t>(std::max(2LL, ringSlots)));
+    global_truncated_packets = 0;
+    global_statistics.reset();
+    global_consumer_running = true;
+    IO_DEBUG(t("packet_ring_capacity") + ": " + std::to_string(global_packet_ring->getCapacity()));
+    if (!global_replay && interactive)
+        IO::Info(t("press_s_for_statistics"));
+    const auto loopStart = std::chrono::steady_clock::now();
+    std::thread consumer(consumePackets);
+    std::thread monitor(monitorCapture);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < global_pcap_handles.size(); i++)
+        workers.emplace_back(captureHandle, i);
+    for (auto &worker : workers)
+        worker.join();
+    global_consumer_running = false;
+    consumer.join();
+    monitor.join();
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+    if (global_replay || ARGC::HasArg("verbose") || ARGC::HasArg("capture-stats"))
+        printStatistics();
+    if (global_replay)
+    {
+        const uint64_t processed = global_statistics.processed.load();
+        IO::Info(t("replay_throughput") + ": " + std::to_string(processed) + " " + t("packets_in") + " " +
+                 std::to_string(elapsedSeconds) + " s (" +
+                 std::to_string(elapsedSeconds > 0 ? processed / elapsedSeconds : 0.0) + " " + t("packets_per_second") + ")");
+    }
+    IO_DEBUG(t("packet_ring_high_water") + ": " + std::to_string(global_packet_ring->getHighWater()) + "/" +
+             std::to_string(global_packet_ring->getCapacity()));
+    if (global_packet_ring->getOverflows() > 0)
+        IO::Warn(t("packet_ring_overflows") + ": " + std::to_string(global_packet_ring->getOverflows()));
+    if (global_truncated_packets > 0)
+        IO::Warn(t("packet_ring_truncated") + ": " + std::to_string(global_truncated_packets.load()));
+    global_packet_ring.reset();
+    IO_DEBUG(t("closing_capture_handle"));
+    for (pcap_t *handle : global_pcap_handles)
+        pcap_close(handle);
+    global_pcap_handles.clear();
 }
@@ -21,8 +21,13 @@
 #include <vector>
 #include <regex>
 #include "json.hpp"
-#include "network_headers.hpp"
+#include "packetParser.hpp"
 #include "io.hpp"
+#include "ringBuffer.hpp"
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <winsock2.h>
 #include <pcap/pcap.h>
 
 class CAPTURE
@@ -32,15 +37,97 @@ public:
     {
         std::string productUrl;
         nlohmann::json request_body;
+        double captureLatencyMs = 0;
     };
 
+    enum REJECTION
+    {
+        REJECTED_TRUNCATED,
+        REJECTED_NON_IP,
+        REJECTED_NON_TCP,
+        REJECTED_INVALID_TCP_HEADER,
+        REJECTED_WRONG_PORT,
+        REJECTED_EMPTY_PAYLOAD,
+        REJECTED_NO_MATCH,
+        REJECTION_COUNT
+    };
+
+    struct STATISTICS
+    {
+        static const int LATENCY_BUCKET_COUNT = 12;
+        static const uint64_t LATENCY_BOUNDS_US[LATENCY_BUCKET_COUNT - 1];
+
+        // Packet counts from the capture threads, parse results from the
+        // consumer and each handle's kernel counts sit on separate lines.
+        alignas(64) std::atomic<uint64_t> received{0};
+        alignas(64) std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> matched{0};
+        std::atomic<uint64_t> rejections[REJECTION_COUNT] = {};
+        std::atomic<uint64_t> latencyBuckets[LATENCY_BUCKET_COUNT] = {};
+        alignas(64) std::atomic<uint64_t> kernelReceived{0};
+        std::atomic<uint64_t> kernelDropped{0};
+        std::atomic<uint64_t> interfaceDropped{0};
+
+        void reject(REJECTION reason) { rejections[reason].fetch_add(1, std::memory_order_relaxed); }
+        void observeLatency(double latencyMs);
+        void reset();
+    };
+
+    // Called on the capture thread for every matching request; returning
+    // false ends the capture.
+    typedef std::function<bool(CAPTURE_RESULT &result)> MATCH_CALLBACK;
+
     static void capture(CAPTURE_RESULT &result);
+    // Captures until onMatch returns false or stop() is called. The caller
+    // owns the keyboard meanwhile.
+    static void captureEach(const MATCH_CALLBACK &onMatch);
+    static void stop();
+    static const STATISTICS &getStatistics();
+    static void printStatistics();
 
 private:
+    // A checkVersion request fits in one slot; the kernel copies no more
+    // than a slot holds, and anything longer is rejected as truncated.
+    static const int PACKET_SLOT_SIZE = 4096;
+    static const int SNAPSHOT_LENGTH = PACKET_SLOT_SIZE;
+    // Also the read timeout in immediate mode, so quiet handles still tick.
+    static const int KERNEL_STATISTICS_INTERVAL_MS = 1000;
+    // 255.255.255.0 in network order, for adapters that report no mask.
+    static const uint32_t DEFAULT_NETMASK = 0x00ffffff;
+    // Npcap takes the buffer size in bytes as an int.
+    static const long long MAX_CAPTURE_BUFFER_MIB = 2047;
+    static const long long MAX_CAPTURE_TIMEOUT_MS = 60000;
+    struct PACKET
+    {
+        struct timeval timestamp;
+        uint32_t length;
+        uint32_t source;
+        bool truncated;
+        u_char data[PACKET_SLOT_SIZE];
+    };
+
     static void packet_handler(u_char *param, const struct pcap_pkthdr *header, const u_char *pkt_data);
-    static CAPTURE_RESULT *global_capture_result;
-    static pcap_t *global_pcap_handle;
-    static bool IsWantedRequest_NetworkLayer(const u_char **buf, int &len);
-    static bool IsWantedRequest_TransportLayer(const u_char **buf, int &len);
-    static bool IsWantedRequest(const u_char *pkt_data, int data_len, CAPTURE_RESULT &result);
+    static void runCapture(bool interactive);
+    static void consumePackets();
+    static void monitorCapture();
+    static void captureHandle(size_t index);
+    static void updateKernelStatistics(pcap_t *handle, struct pcap_stat &previous);
+    static STATISTICS global_statistics;
+    static MATCH_CALLBACK global_on_match;
+    static bool global_interactive;
+    static std::vector<pcap_t *> global_pcap_handles;
+    static std::unique_ptr<RING_BUFFER<PACKET>> global_packet_ring;
+    static std::atomic<bool> global_consumer_running;
+    static std::atomic<size_t> global_truncated_packets;
+    static std::vector<PACKET_PARSER::PARSE_FUNCTION> global_packet_parsers;
+    static bool global_replay;
+    static long long boundedArgument(const std::string &key, long long defaultValue, long long maximum);
+    static pcap_t *openHandle(const char *deviceName);
+    static uint32_t parseIPv4Argument(const std::string &key, const std::string &defaultValue);
+    static void openInterfaces(std::vector<pcap_t *> &handles, std::vector<u_int> &netmasks);
+    static pcap_t *openReplay(const std::string &filename);
+    static void prepareHandle(pcap_t *handle, u_int netmask);
+    static void breakAllLoops();
+    static double latencySince(const struct timeval &timestamp);
+    static bool IsWantedRequest(const u_char *pkt_data, int data_len, PACKET_PARSER::PARSE_FUNCTION parser, CAPTURE_RESULT &result);
 };
@@ -29,11 +29,11 @@ BOOL CORE::IsAdmin()
 
 void CORE::BindSignal()
 {
-    IO::Debug(t("binding_signal_handlers"));
+    IO_DEBUG(t("binding_signal_handlers"));
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
     signal(SIGABRT, SignalHandler);
-    IO::Debug(t("signal_handlers_bound"));
+    IO_DEBUG(t("signal_handlers_bound"));
 }
 
 void CORE::Header()
@@ -44,16 +44,19 @@ void CORE::Header()
 
 void CORE::ElevateNow()
 {
-    IO::Debug(t("checking_admin_privileges"));
+    IO_DEBUG(t("checking_admin_privileges"));
     if (!IsAdmin())
     {
-        IO::Debug(t("not_admin_requesting_elevation"));
+        IO_DEBUG(t("not_admin_requesting_elevation"));
+        // Nobody is there to accept the UAC prompt.
+        if (ARGC::HasArg("batch"))
+            DIE_WITH(EXIT_NOT_ADMIN, t("batch_requires_admin"));
         if (!IO::Confirm(t("admin_privileges_required")))
             DIE(t("user_declined_elevation"));
         TCHAR ModulePath[MAX_PATH];
         if (!GetModuleFileName(NULL, ModulePath, ARRAYSIZE(ModulePath)))
             DIE(t("failed_get_module_name"));
-        IO::Debug(t("attempting_elevation"));
+        IO_DEBUG(t("attempting_elevation"));
         SHELLEXECUTEINFO ShellExecuteInfo = {sizeof(ShellExecuteInfo)};
         ShellExecuteInfo.lpVerb = TEXT("runas");
         ShellExecuteInfo.lpFile = ModulePath;
@@ -61,11 +64,11 @@ void CORE::ElevateNow()
         ShellExecuteInfo.nShow = SW_SHOWDEFAULT;
         if (!ShellExecuteEx(&ShellExecuteInfo))
             DIE(t("failed_elevate_privileges"));
-        IO::Debug(t("elevation_request_sent"));
+        IO_DEBUG(t("elevation_request_sent"));
         exit(0);
     }
     else
     {
-        IO::Debug(t("already_admin"));
+        IO_DEBUG(t("already_admin"));
     }
 }
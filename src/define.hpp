@@ -18,15 +18,54 @@
 #pragma once
 
 #include <conio.h>
+#include <stdexcept>
+#include <string>
 #include "i18n.hpp"
+#include "argc.hpp"
 
-#define DIE(msg)                                                            \
+// Exit codes, so scripts driving --batch can tell failures apart.
+#define EXIT_FATAL 1
+#define EXIT_NOT_ADMIN 2
+#define EXIT_PEN_TIMEOUT 3
+
+// While a thread holds a FATAL_SCOPE, DIE throws FATAL_ERROR instead of
+// ending the process, so one fleet job failing leaves the others running.
+class FATAL_ERROR : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class FATAL_SCOPE
+{
+public:
+    FATAL_SCOPE() { active() = true; }
+    ~FATAL_SCOPE() { active() = false; }
+    FATAL_SCOPE(const FATAL_SCOPE &) = delete;
+    FATAL_SCOPE &operator=(const FATAL_SCOPE &) = delete;
+
+    static bool &active()
+    {
+        static thread_local bool value = false;
+        return value;
+    }
+};
+
+#define DIE_WITH(code, msg)                                                 \
     do                                                                      \
     {                                                                       \
-        IO::Error(msg);                                                     \
-        IO::Debug(t("occurs_at") + " " + std::string(__PRETTY_FUNCTION__) + \
-                  " (" + std::to_string(GetLastError()) + ")");             \
-        IO::Info(t("press_any_key_exit"));                                  \
-        _getch();                                                           \
-        exit(1);                                                            \
+        const std::string fatalMessage = (msg);                             \
+        IO::Error(fatalMessage);                                            \
+        IO_DEBUG(t("occurs_at") + " " + std::string(__PRETTY_FUNCTION__) +  \
+                 " (" + std::to_string(GetLastError()) + ")");              \
+        if (FATAL_SCOPE::active())                                          \
+            throw FATAL_ERROR(fatalMessage);                                \
+        if (!ARGC::HasArg("batch"))                                         \
+        {                                                                   \
+            IO::Info(t("press_any_key_exit"));                              \
+            IO::Drain();                                                    \
+            _getch();                                                       \
+        }                                                                   \
+        exit(code);                                                         \
     } while (0)
+#define DIE(msg) DIE_WITH(EXIT_FATAL, msg)
@@ -19,93 +19,576 @@
 #include "io.hpp"
 #include "i18n.hpp"
 #include "define.hpp"
-#include <wininet.h>
+#include "argc.hpp"
+#include "mappedFile.hpp"
+#include "hash.hpp"
+#include "cache.hpp"
+#include "trace.hpp"
 #include <fstream>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <charconv>
 
-tstring DOWNLOAD::toTString(std::string s) { return tstring(s.begin(), s.end()); }
+HTTP_CLIENT &DOWNLOAD::client()
+{
+    static HTTP_CLIENT instance(static_cast<int>(ARGC::GetIntArg("http-timeout", 30000)));
+    return instance;
+}
+
+size_t DOWNLOAD::parseContentLength(const std::string &header)
+{
+    size_t length = 0;
+    const char *end = header.data() + header.size();
+    const auto result = std::from_chars(header.data(), end, length);
+    if (result.ec != std::errc() || result.ptr != end)
+    {
+        if (!header.empty())
+            IO_DEBUG(t("invalid_content_length") + ": " + header);
+        return 0;
+    }
+    return length;
+}
+
+void DOWNLOAD::pinOtaServer()
+{
+    std::string host, port, path, error;
+    if (!HTTP_CLIENT::parseUrl("http://" + ARGC::GetArg("ota-server", "iotapi.abupdate.com") + "/", host, port, path) ||
+        !client().pinHost(host, error))
+    {
+        IO::Warn(t("ota_server_not_pinned") + ": " + error);
+        return;
+    }
+    IO_DEBUG(t("ota_server_pinned") + ": " + host);
+}
 
 nlohmann::json DOWNLOAD::getUpdateData(CAPTURE::CAPTURE_RESULT captureResult)
 {
-    IO::Debug(t("preparing_modified_request"));
+    TRACE::SCOPE scope("checkVersion", "network");
+    IO_DEBUG(t("preparing_modified_request"));
     nlohmann::json modifiedBody = captureResult.request_body;
     modifiedBody["version"] = "99.99.90";
     modifiedBody["networkType"] = "WIFI";
-    IO::Debug(t("modified_version_to") + ": " + std::string(modifiedBody["version"]));
+    IO_DEBUG(t("modified_version_to") + ": " + std::string(modifiedBody["version"]));
 
-    IO::Debug(t("initializing_wininet"));
-    HINTERNET hInternet = InternetOpen(TEXT(""), INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
-    IO::Debug(t("connecting_to_server"));
-    HINTERNET hConnect = InternetConnect(hInternet, TEXT("iotapi.abupdate.com"), INTERNET_DEFAULT_HTTP_PORT, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
-    IO::Debug(t("opening_http_request_for") + ": " + captureResult.productUrl);
-    HINTERNET hRequest = HttpOpenRequest(hConnect, TEXT("POST"), toTString(captureResult.productUrl).c_str(), NULL, NULL, NULL, 0, 0);
-    HttpAddRequestHeaders(hRequest, TEXT("Content-Type: application/json;charset=UTF-8"), -1, HTTP_ADDREQ_FLAG_ADD);
+    // The answer depends on the product and the version the device reports,
+    // not on the device itself, so one response serves a whole batch.
+    const std::string cacheKey = CACHE::responseKey(captureResult.productUrl, captureResult.request_body.value("version", ""));
+    const long long cacheTtl = ARGC::GetIntArg("ota-cache-ttl", 3600);
+    nlohmann::json cachedResponse;
+    if (cacheTtl > 0 && CACHE::lookupResponse(cacheKey, cacheTtl, cachedResponse))
+    {
+        IO::Info(t("using_cached_update_data"));
+        IO_DEBUG(t("response_json") + ": " + cachedResponse.dump(2, ' '));
+        return cachedResponse;
+    }
 
+    const std::string url = "http://" + ARGC::GetArg("ota-server", "iotapi.abupdate.com") + captureResult.productUrl;
     std::string bodyStr = modifiedBody.dump();
-    DWORD bodyLength = static_cast<DWORD>(bodyStr.length());
-    IO::Debug(t("request_body_size") + ": " + std::to_string(bodyLength) + " " + t("bytes"));
-
-    IO::Debug(t("sending_http_request"));
-    HttpSendRequest(hRequest, NULL, 0, (LPVOID)bodyStr.c_str(), bodyLength);
-
-    IO::Debug(t("reading_http_response"));
-    std::string response;
-    char buffer[4096];
-    DWORD dwRead = 0;
-    while (InternetReadFile(hRequest, buffer, sizeof(buffer), &dwRead) && dwRead > 0)
-        response.append(buffer, dwRead);
-
-    IO::Debug(t("response_size") + ": " + std::to_string(response.length()) + " " + t("bytes"));
-    InternetCloseHandle(hRequest);
-    InternetCloseHandle(hConnect);
-    InternetCloseHandle(hInternet);
-
-    IO::Debug(t("parsing_json_response"));
-    nlohmann::json responseJson = nlohmann::json::parse(response);
-    IO::Debug(t("json_response_parsed"));
-    IO::Debug(t("response_json") + ": " + responseJson.dump(2, ' '));
+    IO_DEBUG(t("request_body_size") + ": " + std::to_string(bodyStr.length()) + " " + t("bytes"));
+
+    IO_DEBUG(t("opening_http_request_for") + ": " + url);
+    IO_DEBUG(t("sending_http_request"));
+    HTTP_CLIENT::RESPONSE response;
+    nlohmann::json responseJson;
+    std::string failure;
+    if (!client().request("POST", url, {{"Content-Type", "application/json;charset=UTF-8"}}, bodyStr, response))
+        failure = response.error;
+    else if (response.statusCode < 200 || response.statusCode >= 300)
+        failure = "HTTP " + std::to_string(response.statusCode);
+    else
+    {
+        IO_DEBUG(t("response_size") + ": " + std::to_string(response.body.length()) + " " + t("bytes"));
+        IO_DEBUG(t("parsing_json_response"));
+        try
+        {
+            responseJson = nlohmann::json::parse(response.body);
+        }
+        catch (const nlohmann::json::exception &e)
+        {
+            failure = t("failed_parse_json") + ": " + e.what();
+        }
+    }
+    if (!failure.empty())
+    {
+        // An expired answer beats no answer when the server is unreachable
+        // or answers with an error page instead of JSON.
+        if (CACHE::lookupResponse(cacheKey, -1, cachedResponse))
+        {
+            IO::Warn(t("using_stale_update_data") + ": " + failure);
+            return cachedResponse;
+        }
+        DIE(t("failed_fetch_update_data") + ": " + failure);
+    }
+    IO_DEBUG(t("json_response_parsed"));
+    IO_DEBUG(t("response_json") + ": " + responseJson.dump(2, ' '));
+    if (cacheTtl > 0 && responseJson.contains("data") && responseJson["data"].contains("version") &&
+        responseJson["data"]["version"].contains("deltaUrl"))
+        CACHE::storeResponse(cacheKey, responseJson);
     return responseJson;
 }
-void DOWNLOAD::downloadFile(std::string url, std::string filename)
+
+DOWNLOAD::EXPECTED_HASHES DOWNLOAD::parseExpectedHashes(const nlohmann::json &version)
 {
-    if (std::filesystem::exists(filename) && IO::Confirm(t("file_exists_skip_download")))
+    auto lower = [](std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                       { return std::tolower(c); });
+        return value;
+    };
+    EXPECTED_HASHES expected;
+    expected.md5sum = lower(version.value("md5sum", ""));
+    expected.sha = lower(version.value("sha", ""));
+    try
+    {
+        // segmentMd5 is itself a JSON document embedded as a string.
+        for (const auto &segment : nlohmann::json::parse(version.value("segmentMd5", "[]")))
+            expected.segments.push_back({segment["startpos"], segment["endpos"], lower(segment["md5"])});
+    }
+    catch (const nlohmann::json::exception &e)
+    {
+        IO::Warn(t("segment_md5_unreadable") + ": " + e.what());
+        expected.segments.clear();
+    }
+    std::sort(expected.segments.begin(), expected.segments.end(), [](const SEGMENT &a, const SEGMENT &b)
+              { return a.start < b.start; });
+    return expected;
+}
+
+nlohmann::json DOWNLOAD::planRanges(size_t contentLength, size_t chunkSize, const EXPECTED_HASHES &expected)
+{
+    // Each segment with a known MD5 becomes one range so it can be checked,
+    // and re-fetched, on its own; the gaps between them use --chunk-size.
+    nlohmann::json ranges = nlohmann::json::array();
+    size_t position = 0;
+    auto fillUntil = [&](size_t end)
+    {
+        for (; position < end; position = std::min(position + chunkSize, end))
+            ranges.push_back({position, std::min(position + chunkSize, end), ""});
+    };
+    for (const auto &segment : expected.segments)
+    {
+        if (segment.start < position || segment.end <= segment.start || segment.end > contentLength)
+            continue;
+        fillUntil(segment.start);
+        ranges.push_back({segment.start, segment.end, segment.md5});
+        position = segment.end;
+    }
+    fillUntil(contentLength);
+    return ranges;
+}
+
+void DOWNLOAD::verifyImage(HASH::STREAM &digest, const EXPECTED_HASHES &expected, std::string filename, std::string journalFile)
+{
+    TRACE::SCOPE scope("verify image", "hash");
+    std::string md5, sha1;
+    digest.finish(md5, sha1);
+    IO_DEBUG(t("downloaded_image_md5") + ": " + md5 + ", " + t("downloaded_image_sha") + ": " + sha1);
+    if ((expected.md5sum.empty() || expected.md5sum == md5) && (expected.sha.empty() || expected.sha == sha1))
         return;
+    // Every segment matched yet the whole does not, so there is no range to
+    // blame; start from scratch next time.
+    std::filesystem::remove(journalFile);
+    std::filesystem::remove(filename);
+    DIE(t("downloaded_image_hash_mismatch") + ": md5 " + md5 + "/" + expected.md5sum + ", sha " + sha1 + "/" + expected.sha);
+}
 
-    IO::Info(t("downloading_image_file"));
+void DOWNLOAD::downloadSingleStream(std::string url, std::string filename, const EXPECTED_HASHES &expected, std::string journalFile,
+                                    const PREFIX_CALLBACK &onPrefix)
+{
+    TRACE::SCOPE scope("single stream", "network");
+    std::unique_ptr<MAPPED_FILE> mapped;
+    std::ofstream stream;
+    HASH::STREAM digest;
+    size_t contentLength = 0;
+    size_t totalDownloaded = 0;
+    HTTP_CLIENT::RESPONSE response;
+    const bool completed = client().request(
+        "GET", url, {}, "", response,
+        [&](const HTTP_CLIENT::RESPONSE &headers)
+        {
+            if (headers.statusCode != 200)
+                return false;
+            contentLength = parseContentLength(headers.getHeader("content-length"));
+            if (contentLength > 0)
+                mapped.reset(new MAPPED_FILE(filename, contentLength));
+            else
+            {
+                // Nothing to preallocate without a length; grow the file as data arrives.
+                stream.open(filename, std::ios::binary | std::ios::trunc);
+                if (!stream.is_open())
+                    DIE(t("failed_create_output_file"));
+            }
+            return true;
+        },
+        [&](const char *data, size_t length)
+        {
+            if (mapped)
+            {
+                if (length > contentLength - totalDownloaded)
+                    return false;
+                std::memcpy(mapped->data() + totalDownloaded, data, length);
+            }
+            else
+                stream.write(data, length);
+            digest.update(data, length);
+            totalDownloaded += length;
+            if (contentLength > 0)
+                IO::ShowProgress(static_cast<double>(totalDownloaded) / contentLength * 100.0, totalDownloaded, contentLength);
+            return true;
+        });
+    if (!completed || response.statusCode != 200 || (contentLength > 0 && totalDownloaded != contentLength))
+    {
+        IO::FlushProgress();
+        DIE(t("download_incomplete") + ": " + std::to_string(totalDownloaded) + "/" + std::to_string(contentLength) +
+            " (" + std::to_string(response.statusCode) + " " + response.error + ")");
+    }
+    mapped.reset();
+    stream.close();
 
-    HINTERNET hInternet = InternetOpen(TEXT(""), INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
-    if (!hInternet)
-        DIE(t("failed_initialize_wininet"));
+    // Without range support a bad segment cannot be fetched on its own.
+    for (const auto &segment : expected.segments)
+        if (segment.end <= totalDownloaded && HASH::MD5FileSegment(filename, segment.start, segment.end) != segment.md5)
+        {
+            std::filesystem::remove(journalFile);
+            std::filesystem::remove(filename);
+            DIE(t("segment_md5_mismatch") + ": " + std::to_string(segment.start) + "-" + std::to_string(segment.end));
+        }
+    verifyImage(digest, expected, filename, journalFile);
+    // Nothing can be handed on before the segments are checked, since a bad
+    // one means starting over.
+    if (onPrefix && contentLength > 0)
+    {
+        MAPPED_FILE image(filename, MAPPED_FILE::WRITE);
+        onPrefix(image.data(), image.size(), image.size());
+    }
+}
 
-    HINTERNET hUrl = InternetOpenUrl(hInternet, toTString(url).c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
-    if (!hUrl)
-        DIE(t("failed_open_url"));
+DOWNLOAD::FETCH_RESULT DOWNLOAD::fetchRange(std::string url, std::string ifRange, unsigned char *image, size_t start, size_t end,
+                                            std::atomic<size_t> &downloaded)
+{
+    TRACE::SCOPE scope("range", "network");
+    std::map<std::string, std::string> headers = {{"Range", "bytes=" + std::to_string(start) + "-" + std::to_string(end)}};
+    // If the file changed on the server, If-Range turns the reply into a
+    // 200 with the new content, which is rejected below.
+    if (!ifRange.empty())
+        headers["If-Range"] = ifRange;
 
-    DWORD contentLength = 0;
-    DWORD bufferSize = sizeof(contentLength);
-    HttpQueryInfo(hUrl, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER,
-                  &contentLength, &bufferSize, NULL);
+    size_t position = start;
+    HTTP_CLIENT::RESPONSE response;
+    const bool completed = client().request(
+        "GET", url, headers, "", response,
+        [](const HTTP_CLIENT::RESPONSE &headers)
+        { return headers.statusCode == 206; },
+        [&](const char *data, size_t length)
+        {
+            if (length > end + 1 - position)
+                return false;
+            std::memcpy(image + position, data, length);
+            position += length;
+            downloaded.fetch_add(length, std::memory_order_relaxed);
+            return true;
+        });
+    if (!completed || position <= end)
+    {
+        // Forget the partial progress; the whole range is fetched again.
+        downloaded.fetch_sub(position - start, std::memory_order_relaxed);
+        return response.statusCode == 200 ? RANGE_IGNORED : RANGE_FAILED;
+    }
+    return RANGE_FETCHED;
+}
 
-    std::ofstream outFile(filename, std::ios::binary);
-    if (!outFile.is_open())
-        DIE(t("failed_create_output_file"));
+bool DOWNLOAD::loadJournal(std::string journalFile, nlohmann::json &journal)
+{
+    std::ifstream file(journalFile);
+    if (!file.is_open())
+        return false;
+    try
+    {
+        journal = nlohmann::json::parse(file);
+    }
+    catch (const nlohmann::json::exception &e)
+    {
+        IO::Warn(t("download_journal_corrupted") + ": " + e.what());
+        return false;
+    }
+    return journal.is_object();
+}
 
-    char buffer[1024 * 1024];
-    DWORD bytesRead = 0;
-    size_t totalDownloaded = 0;
+void DOWNLOAD::saveJournal(std::string journalFile, const nlohmann::json &journal)
+{
+    const std::string temporaryFile = journalFile + ".tmp";
+    {
+        std::ofstream file(temporaryFile, std::ios::trunc);
+        if (!file.is_open())
+            DIE(t("failed_write_download_journal") + ": " + journalFile);
+        file << journal.dump();
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryFile, journalFile, error);
+    if (error)
+        DIE(t("failed_write_download_journal") + ": " + journalFile + " (" + error.message() + ")");
+}
+
+bool DOWNLOAD::isSameDownload(const nlohmann::json &previous, const nlohmann::json &current)
+{
+    for (const char *key : {"url", "length", "etag", "lastModified"})
+        if (previous.value(key, nlohmann::json()) != current[key])
+            return false;
+    return previous.contains("ranges") && previous["ranges"].is_array() &&
+           previous.contains("completed") && previous["completed"].is_array();
+}
+
+bool DOWNLOAD::downloadRanges(std::string url, std::string filename, const EXPECTED_HASHES &expected,
+                              nlohmann::json &journal, std::string journalFile, const PREFIX_CALLBACK &onPrefix)
+{
+    struct RANGE
+    {
+        size_t start;
+        size_t end;
+        std::string md5;
+    };
+    const size_t contentLength = journal["length"];
+    // A weak ETag must not be used in If-Range (RFC 7233): the server would
+    // ignore the range and send the whole file.
+    const std::string etag = journal["etag"];
+    const std::string ifRange = !etag.empty() && etag.compare(0, 2, "W/") != 0 ? etag : journal["lastModified"].get<std::string>();
+    const size_t connections = static_cast<size_t>(std::max(1LL, ARGC::GetIntArg("connections", 4)));
+    std::vector<RANGE> ranges;
+    for (const auto &range : journal["ranges"])
+        ranges.push_back({range[0], range[1], range[2]});
+    const size_t rangeCount = ranges.size();
+
+    // Set once a range is verified and on disk; the full-image hash follows
+    // the completed prefix while the rest is still downloading.
+    std::unique_ptr<std::atomic<bool>[]> completed(new std::atomic<bool>[rangeCount]);
+    for (size_t i = 0; i < rangeCount; i++)
+        completed[i] = false;
+    IO_DEBUG(t("parallel_download") + ": " + std::to_string(connections) + " " + t("connections") + ", " +
+             std::to_string(rangeCount) + " " + t("chunks") + ", " + std::to_string(expected.segments.size()) + " " + t("verified_segments"));
+
+    MAPPED_FILE output(filename, contentLength);
+    // The journal only says the bytes were written; a range that can be
+    // checked is checked again before it is trusted.
+    size_t alreadyDownloaded = 0;
+    nlohmann::json stillCompleted = nlohmann::json::array();
+    for (size_t index : journal["completed"])
+    {
+        if (index >= rangeCount || completed[index])
+            continue;
+        const RANGE &range = ranges[index];
+        if (!range.md5.empty() && HASH::MD5Buffer(output.data() + range.start, range.end - range.start) != range.md5)
+        {
+            IO::Warn(t("segment_md5_mismatch") + ": " + std::to_string(range.start) + "-" + std::to_string(range.end - 1));
+            continue;
+        }
+        completed[index] = true;
+        stillCompleted.push_back(index);
+        alreadyDownloaded += range.end - range.start;
+    }
+    if (stillCompleted.size() != journal["completed"].size())
+    {
+        journal["completed"] = stillCompleted;
+        saveJournal(journalFile, journal);
+    }
+    HASH::STREAM digest;
+    size_t hashedRanges = 0;
+    auto advanceDigest = [&]()
+    {
+        const size_t previous = hashedRanges;
+        while (hashedRanges < rangeCount && completed[hashedRanges])
+        {
+            digest.update(output.data() + ranges[hashedRanges].start, ranges[hashedRanges].end - ranges[hashedRanges].start);
+            hashedRanges++;
+        }
+        // The original bytes are hashed before the consumer may change them.
+        if (onPrefix && hashedRanges > previous)
+            onPrefix(output.data(), ranges[hashedRanges - 1].end, contentLength);
+    };
+
+    std::mutex journalMutex;
+    std::atomic<size_t> nextRange(0);
+    std::atomic<size_t> downloaded(alreadyDownloaded);
+    std::atomic<size_t> activeWorkers(connections);
+    std::atomic<bool> failed(false);
+    std::atomic<bool> rangesIgnored(false);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < connections; i++)
+        workers.emplace_back(
+            [&]()
+            {
+                size_t index;
+                while (!failed && (index = nextRange.fetch_add(1)) < rangeCount)
+                {
+                    if (completed[index])
+                        continue;
+                    const RANGE &range = ranges[index];
+                    const std::string description = std::to_string(range.start) + "-" + std::to_string(range.end - 1);
+                    int attempt = 0;
+                    bool fetched;
+                    while (true)
+                    {
+                        const FETCH_RESULT result = fetchRange(url, ifRange, output.data(), range.start, range.end - 1, downloaded);
+                        if (result == RANGE_IGNORED)
+                        {
+                            // Retrying cannot help; the server will keep
+                            // sending the whole file.
+                            IO_DEBUG(t("range_request_ignored") + ": " + description);
+                            rangesIgnored = true;
+                            failed = true;
+                            fetched = false;
+                            break;
+                        }
+                        fetched = result == RANGE_FETCHED;
+                        // The bytes are still hot in cache; check them before
+                        // anything else is built on top.
+                        if (fetched && !range.md5.empty() &&
+                            HASH::MD5Buffer(output.data() + range.start, range.end - range.start) != range.md5)
+                        {
+                            IO::Warn(t("segment_md5_mismatch") + ": " + description);
+                            downloaded.fetch_sub(range.end - range.start, std::memory_order_relaxed);
+                            fetched = false;
+                        }
+                        if (fetched)
+                            break;
+                        if (++attempt >= 3)
+                        {
+                            IO::Warn(t("range_download_failed") + ": " + description);
+                            failed = true;
+                            break;
+                        }
+                        IO_DEBUG(t("retrying_range") + ": " + description);
+                    }
+                    if (fetched)
+                    {
+                        // The range only counts as done once its bytes are on disk.
+                        std::lock_guard<std::mutex> lock(journalMutex);
+                        output.flush(range.start, range.end - range.start);
+                        journal["completed"].push_back(index);
+                        saveJournal(journalFile, journal);
+                        completed[index] = true;
+                    }
+                }
+                activeWorkers--;
+            });
 
-    while (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0)
+    while (activeWorkers > 0)
+    {
+        advanceDigest();
+        const size_t current = downloaded.load(std::memory_order_relaxed);
+        IO::ShowProgress(static_cast<double>(current) / contentLength * 100.0, current, contentLength);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    for (auto &worker : workers)
+        worker.join();
+    if (failed)
     {
-        outFile.write(buffer, bytesRead);
-        totalDownloaded += bytesRead;
+        IO::FlushProgress();
+        // Bytes already handed to the consumer cannot be taken back, so a
+        // single stream may only start over while none have been.
+        if (rangesIgnored && (!onPrefix || hashedRanges == 0))
+        {
+            IO::Warn(t("restarting_single_stream"));
+            journal["completed"] = nlohmann::json::array();
+            saveJournal(journalFile, journal);
+            return false;
+        }
+        DIE(t("download_incomplete") + ": " + std::to_string(downloaded.load()) + "/" + std::to_string(contentLength));
+    }
+    IO::ShowProgress(100.0, contentLength, contentLength);
+    advanceDigest();
+    verifyImage(digest, expected, filename, journalFile);
+    return true;
+}
 
-        if (contentLength > 0)
+bool DOWNLOAD::prefetchFile(std::string url, std::string filename, const EXPECTED_HASHES &expected, const std::atomic<bool> &cancel)
+{
+    // Speculative, so every failure is reported and swallowed: one plain
+    // stream, checked against the server hashes before it is kept.
+    IO_DEBUG(t("prefetching_image") + ": " + url);
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+    HASH::STREAM digest;
+    HTTP_CLIENT::RESPONSE response;
+    const bool completed = client().request(
+        "GET", url, {}, "", response,
+        [](const HTTP_CLIENT::RESPONSE &headers)
+        { return headers.statusCode == 200; },
+        [&](const char *data, size_t length)
         {
-            double percentage = (static_cast<double>(totalDownloaded) / contentLength) * 100.0;
-            IO::ShowProgress(percentage, totalDownloaded, contentLength);
+            file.write(data, length);
+            digest.update(data, length);
+            return !cancel && file.good();
+        });
+    file.close();
+    std::string md5, sha1;
+    digest.finish(md5, sha1);
+    if (!completed || (!expected.md5sum.empty() && expected.md5sum != md5) || (!expected.sha.empty() && expected.sha != sha1))
+    {
+        IO_DEBUG(t(cancel ? "prefetch_cancelled" : "prefetch_failed") + ": " + std::to_string(response.statusCode) + " " + response.error);
+        std::error_code error;
+        std::filesystem::remove(filename, error);
+        return false;
+    }
+    return true;
+}
+
+void DOWNLOAD::downloadFile(std::string url, std::string filename, const EXPECTED_HASHES &expected, const PREFIX_CALLBACK &onPrefix)
+{
+    TRACE::SCOPE scope("download");
+    // The journal exists from before the first byte is written until the
+    // last one is on disk, so a file with a journal is never complete.
+    const std::string journalFile = filename + ".journal";
+    const bool hasJournal = std::filesystem::exists(journalFile);
+    const std::string overwrite = ARGC::GetArg("overwrite", ARGC::HasArg("batch") ? "yes" : "ask");
+    if (!hasJournal && std::filesystem::exists(filename) &&
+        (overwrite == "no" || (overwrite == "ask" && IO::Confirm(t("file_exists_skip_download")))))
+        return;
+
+    IO::Info(t("downloading_image_file"));
+
+    // The probe and every later request share pooled keep-alive connections.
+    HTTP_CLIENT::RESPONSE probe;
+    if (!client().request("HEAD", url, {}, "", probe) || probe.statusCode != 200)
+        IO_DEBUG(t("download_probe_failed") + ": " + std::to_string(probe.statusCode) + " " + probe.error);
+    const size_t contentLength = probe.statusCode == 200 ? parseContentLength(probe.getHeader("content-length")) : 0;
+    const bool acceptsRanges = probe.statusCode == 200 && probe.getHeader("accept-ranges") == "bytes";
+    IO_DEBUG(t("content_length") + ": " + std::to_string(contentLength) + ", " + t("accept_ranges") + ": " + (acceptsRanges ? "bytes" : "none"));
+
+    nlohmann::json journal = {
+        {"url", url},
+        {"length", contentLength},
+        {"etag", probe.getHeader("etag")},
+        {"lastModified", probe.getHeader("last-modified")},
+        {"ranges", planRanges(contentLength, static_cast<size_t>(std::max(1LL, ARGC::GetIntArg("chunk-size", 8))) * 1024 * 1024, expected)},
+        {"completed", nlohmann::json::array()}};
+    nlohmann::json previous;
+    if (hasJournal && loadJournal(journalFile, previous))
+    {
+        if (isSameDownload(previous, journal) && std::filesystem::exists(filename))
+        {
+            journal["ranges"] = previous["ranges"];
+            journal["completed"] = previous["completed"];
+            IO::Info(t("resuming_download") + ": " + std::to_string(journal["completed"].size()) + " " + t("chunks"));
         }
+        else
+            IO::Warn(t("download_journal_mismatch"));
     }
+    saveJournal(journalFile, journal);
 
-    outFile.close();
-    InternetCloseHandle(hUrl);
-    InternetCloseHandle(hInternet);
+    // Ranged transfers are used even with one connection: they are what
+    // lets a segment that fails verification be fetched again on its own.
+    if (!(contentLength > 0 && acceptsRanges) || !downloadRanges(url, filename, expected, journal, journalFile, onPrefix))
+    {
+        if (contentLength == 0)
+            IO::Warn(t("could_not_get_content_length"));
+        downloadSingleStream(url, filename, expected, journalFile, onPrefix);
+    }
+    std::filesystem::remove(journalFile);
+    IO_DEBUG(t("download_completed"));
 }
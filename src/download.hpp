@@ -19,19 +19,64 @@
 
 #include "json.hpp"
 #include "capture.hpp"
-
-#ifdef UNICODE
-#define tstring std::wstring
-#else
-#define tstring std::string
-#endif
+#include "httpClient.hpp"
+#include "hash.hpp"
+#include <atomic>
+#include <functional>
+#include <vector>
 
 class DOWNLOAD
 {
+public:
+    // Hashes the OTA server publishes for the original image, checked while
+    // the image is downloaded. Segment ranges are [start, end).
+    struct SEGMENT
+    {
+        size_t start;
+        size_t end;
+        std::string md5;
+    };
+    struct EXPECTED_HASHES
+    {
+        std::vector<SEGMENT> segments;
+        std::string md5sum;
+        std::string sha;
+    };
+    // Receives the whole image mapping each time the verified, contiguous
+    // prefix [0, available) grows. The consumer may modify those bytes.
+    typedef std::function<void(unsigned char *data, size_t available, size_t size)> PREFIX_CALLBACK;
+
 private:
-    static tstring toTString(std::string s);
+    static HTTP_CLIENT &client();
+    // 0, meaning unknown, unless the header is a plain decimal number.
+    static size_t parseContentLength(const std::string &header);
+    static nlohmann::json planRanges(size_t contentLength, size_t chunkSize, const EXPECTED_HASHES &expected);
+    static void verifyImage(HASH::STREAM &digest, const EXPECTED_HASHES &expected, std::string filename, std::string journalFile);
+    static void downloadSingleStream(std::string url, std::string filename, const EXPECTED_HASHES &expected, std::string journalFile,
+                                     const PREFIX_CALLBACK &onPrefix);
+    enum FETCH_RESULT
+    {
+        RANGE_FETCHED,
+        RANGE_FAILED,
+        // The server answered with the whole file (200) instead of a range.
+        RANGE_IGNORED,
+    };
+    static FETCH_RESULT fetchRange(std::string url, std::string ifRange, unsigned char *image, size_t start, size_t end,
+                                   std::atomic<size_t> &downloaded);
+    // False if the server stopped honouring ranges before any of the image
+    // was handed to onPrefix, so the caller can start over as one stream.
+    static bool downloadRanges(std::string url, std::string filename, const EXPECTED_HASHES &expected,
+                               nlohmann::json &journal, std::string journalFile, const PREFIX_CALLBACK &onPrefix);
+    static bool loadJournal(std::string journalFile, nlohmann::json &journal);
+    static void saveJournal(std::string journalFile, const nlohmann::json &journal);
+    static bool isSameDownload(const nlohmann::json &previous, const nlohmann::json &current);
 
 public:
     static nlohmann::json getUpdateData(CAPTURE::CAPTURE_RESULT captureResult);
-    static void downloadFile(std::string url, std::string filename);
+    // Keeps the OTA server reachable after HOST::enable redirects its name.
+    static void pinOtaServer();
+    static EXPECTED_HASHES parseExpectedHashes(const nlohmann::json &version);
+    static void downloadFile(std::string url, std::string filename, const EXPECTED_HASHES &expected,
+                             const PREFIX_CALLBACK &onPrefix = nullptr);
+    static bool prefetchFile(std::string url, std::string filename, const EXPECTED_HASHES &expected, const std::atomic<bool> &cancel);
 };
@@ -0,0 +1,237 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "fleet.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include "argc.hpp"
+#include "download.hpp"
+#include "cache.hpp"
+#include "hash.hpp"
+#include "host.hpp"
+#include "trace.hpp"
+#include <conio.h>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+FLEET::STAGE::STAGE(long long limit) : free(std::max(1LL, limit)) {}
+
+void FLEET::STAGE::enter()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [this]()
+                  { return free > 0; });
+    free--;
+}
+
+void FLEET::STAGE::leave()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    free++;
+    released.notify_one();
+}
+
+FLEET::FLEET(std::string imageFile)
+    : imageFile(imageFile),
+      server(80),
+      downloads(ARGC::GetIntArg("fleet-downloads", 2)),
+      hashes(ARGC::GetIntArg("fleet-hashes", std::max(1u, std::thread::hardware_concurrency())))
+{
+}
+
+std::string FLEET::jobImageFile(size_t number) const
+{
+    std::filesystem::path path(imageFile);
+    path.replace_filename(path.stem().string() + "-" + std::to_string(number) + path.extension().string());
+    return path.string();
+}
+
+void FLEET::run()
+{
+    IO::Info(t("fleet_mode_started"));
+    // Jobs still ask the real OTA server after its name is redirected here.
+    DOWNLOAD::pinOtaServer();
+    HOST::enable();
+    server.start();
+    std::thread capturer(
+        [this]()
+        {
+            CAPTURE::captureEach([this](CAPTURE::CAPTURE_RESULT &result)
+                                 { return submit(result); });
+        });
+    serveConsole();
+
+    stopping = true;
+    CAPTURE::stop();
+    capturer.join();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        for (JOB *job : passwordRequests)
+            job->password.set_value("");
+        passwordRequests.clear();
+    }
+    IO::Info(t("fleet_waiting_jobs"));
+    for (auto &job : jobs)
+        job.second->worker.join();
+    server.stop();
+    HOST::disable();
+}
+
+bool FLEET::submit(CAPTURE::CAPTURE_RESULT &result)
+{
+    const std::string otaUrl = result.productUrl.substr(0, result.productUrl.find_last_of('/'));
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    if (stopping || jobs.count(otaUrl))
+        return !stopping;
+
+    std::unique_ptr<JOB> job(new JOB);
+    job->number = jobs.size() + 1;
+    job->result = std::move(result);
+    job->imageFile = jobImageFile(job->number);
+    job->imagePath = "/image/" + std::to_string(job->number) + ".img";
+    job->image.reset(new IMAGE(job->imageFile));
+    job->passwordReady = job->password.get_future();
+    IO::Info("#" + std::to_string(job->number) + " " + t("fleet_job_captured") + ": " +
+             job->result.request_body.value("mid", std::string()));
+    // Routed right away, so the pen's next poll waits for its own answer.
+    server.addRoute(otaUrl, job->imagePath, *job->image);
+    passwordRequests.push_back(job.get());
+    JOB &started = *job;
+    jobs[otaUrl] = std::move(job);
+    started.worker = std::thread([this, &started]()
+                                 { process(started); });
+    return true;
+}
+
+FLEET::JOB *FLEET::nextPasswordRequest()
+{
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    if (passwordRequests.empty())
+        return nullptr;
+    JOB *job = passwordRequests.front();
+    passwordRequests.pop_front();
+    return job;
+}
+
+void FLEET::serveConsole()
+{
+    // Only this thread reads the keyboard, so password prompts for new pens
+    // never race the [x] key.
+    IO::Info(t("fleet_press_x"));
+    while (true)
+    {
+        JOB *job = nextPasswordRequest();
+        if (job)
+        {
+            IO::Info("#" + std::to_string(job->number) + " " + t("fleet_password_for_job") + ": " +
+                     job->result.request_body.value("mid", std::string()));
+            job->password.set_value(HASH::readNewPassword());
+            continue;
+        }
+        if (!_kbhit())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        const int key = std::tolower(_getch());
+        if (key == 'x')
+            return;
+        if (key == 's')
+            CAPTURE::printStatistics();
+    }
+}
+
+void FLEET::process(JOB &job)
+{
+    TRACE::SCOPE scope("job", "fleet");
+    const std::string tag = "#" + std::to_string(job.number) + " ";
+    // A failing job ends alone: its pen is answered with 404 while every
+    // other pen keeps being served.
+    FATAL_SCOPE fatal;
+    try
+    {
+        runJob(job, tag);
+    }
+    catch (const std::exception &e)
+    {
+        IO::Error(tag + t("fleet_job_failed") + ": " + e.what());
+        job.image->abort();
+    }
+}
+
+void FLEET::runJob(JOB &job, const std::string &tag)
+{
+    nlohmann::json updateData;
+    std::string deltaUrl;
+    DOWNLOAD::EXPECTED_HASHES expected;
+    std::string basePath;
+    {
+        // Downloads share the uplink; more at once only slows each one.
+        STAGE::SLOT slot(downloads);
+        IO::Info(tag + t("fleet_job_downloading"));
+        updateData = DOWNLOAD::getUpdateData(job.result);
+        deltaUrl = updateData["data"]["version"]["deltaUrl"];
+        expected = DOWNLOAD::parseExpectedHashes(updateData["data"]["version"]);
+        // Pens on the same firmware all serve the one cache entry.
+        basePath = CACHE::locateImage(deltaUrl, expected, job.imageFile);
+    }
+
+    const std::string password = job.passwordReady.get();
+    if (password.empty())
+    {
+        // Its route stays, so the pen is told there is nothing coming
+        // instead of waiting on an image that is never published.
+        IO::Warn(tag + t("fleet_job_abandoned"));
+        job.image->abort();
+        return;
+    }
+    const std::string hintKey = CACHE::hintKey(job.result.productUrl, job.result.request_body.value("version", ""), expected.md5sum);
+    size_t hintOffset = 0, hintLength = 0;
+    CACHE::lookupPasswordOffset(hintKey, deltaUrl, expected.md5sum, hintOffset, hintLength);
+    const std::pair<size_t, size_t> position = HASH::locatePassword(basePath, hintOffset, hintLength);
+    CACHE::recordPasswordOffset(hintKey, position.first, position.second);
+    const HASH::PATCH patch = HASH::patchFor(basePath, position, password);
+
+    auto segmentMd5 = nlohmann::json::parse(std::string(updateData["data"]["version"]["segmentMd5"]));
+    {
+        STAGE::SLOT slot(hashes);
+        IO::Info(tag + t("calculating_hash"));
+        std::string md5, sha1, pristineMd5;
+        HASH::digestPatched(basePath, {patch}, segmentMd5, md5, sha1, pristineMd5);
+        if (!expected.md5sum.empty() && pristineMd5 != expected.md5sum)
+        {
+            if (basePath != job.imageFile)
+                CACHE::invalidate(deltaUrl, expected.md5sum);
+            DIE(tag + t("served_image_corrupted") + ": " + pristineMd5 + " != " + expected.md5sum);
+        }
+        updateData["data"]["version"]["md5sum"] = md5;
+        updateData["data"]["version"]["sha"] = sha1;
+    }
+    job.image->overlay(basePath, {patch});
+    updateData["data"]["version"]["segmentMd5"] = segmentMd5.dump();
+    updateData["data"]["version"]["deltaUrl"] =
+        updateData["data"]["version"]["bakUrl"] =
+            "http://192.168.137.1" + job.imagePath;
+
+    IO_DEBUG(updateData.dump(2, ' '));
+    job.image->publish(updateData.dump());
+    CACHE::recordServed(CACHE::responseKey(job.result.productUrl, job.result.request_body.value("version", "")));
+    IO::Info(tag + t("fleet_job_ready"));
+}
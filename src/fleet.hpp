@@ -0,0 +1,95 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <deque>
+#include <map>
+#include "capture.hpp"
+#include "image.hpp"
+#include "httpServer.hpp"
+
+// One station, many pens. Every pen captured becomes a job with its own
+// password, image copy and OTA data, served at its own image path. Jobs run
+// on their own threads and each stage admits a limited number at a time.
+class FLEET
+{
+public:
+    explicit FLEET(std::string imageFile);
+    // Captures and serves until [x] is pressed.
+    void run();
+
+private:
+    // Counting semaphore in front of one stage.
+    class STAGE
+    {
+    public:
+        explicit STAGE(long long limit);
+        void enter();
+        void leave();
+
+        struct SLOT
+        {
+            explicit SLOT(STAGE &stage) : stage(stage) { stage.enter(); }
+            ~SLOT() { stage.leave(); }
+            STAGE &stage;
+        };
+
+    private:
+        std::mutex mutex;
+        std::condition_variable released;
+        long long free;
+    };
+
+    struct JOB
+    {
+        size_t number;
+        CAPTURE::CAPTURE_RESULT result;
+        std::string imageFile;
+        std::string imagePath;
+        std::unique_ptr<IMAGE> image;
+        // Answered on the console thread; empty if the fleet stopped first.
+        std::promise<std::string> password;
+        std::future<std::string> passwordReady;
+        std::thread worker;
+    };
+
+    bool submit(CAPTURE::CAPTURE_RESULT &result);
+    void process(JOB &job);
+    void runJob(JOB &job, const std::string &tag);
+    void serveConsole();
+    JOB *nextPasswordRequest();
+    std::string jobImageFile(size_t number) const;
+
+    const std::string imageFile;
+    HTTP_SERVER server;
+    STAGE downloads;
+    STAGE hashes;
+    std::atomic<bool> stopping{false};
+    std::mutex jobsMutex;
+    // Keyed by OTA URL, which is unique per pen; a pen polling again while
+    // its job runs is not a new job.
+    std::map<std::string, std::unique_ptr<JOB>> jobs;
+    std::deque<JOB *> passwordRequests;
+};
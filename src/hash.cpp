@@ -19,85 +19,64 @@
 #include "io.hpp"
 #include "hash.hpp"
 #include "i18n.hpp"
+#include "mappedFile.hpp"
+#include "imageLayout.hpp"
+#include "patternScanner.hpp"
+#include "argc.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <fstream>
 #include <picohash.h>
 #include <cstring>
 
-bool HASH::isHexChar(char c)
+std::vector<std::pair<size_t, size_t>> HASH::findHashPatterns(const std::string &filename)
 {
-    return (c >= '0' && c <= '9') ||
-           (c >= 'a' && c <= 'f') ||
-           (c >= 'A' && c <= 'F');
+    std::string method;
+    return findHashPatterns(filename, method);
 }
-std::vector<std::pair<size_t, size_t>> HASH::findHashPatterns(const std::string &filename)
+std::vector<std::pair<size_t, size_t>> HASH::findHashPatterns(const std::string &filename, std::string &method)
 {
-    IO::Debug(t("searching_hash_patterns") + ": " + filename);
+    TRACE::SCOPE scope("pattern search", "hash");
+    IO_DEBUG(t("searching_hash_patterns") + ": " + filename);
     std::vector<std::pair<size_t, size_t>> positions;
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    if (!file.is_open())
-        DIE(t("cannot_open_file") + ": " + filename);
-    std::streamsize fileSize = file.tellg();
-    IO::Debug(t("file_size") + ": " + std::to_string(fileSize) + " " + t("bytes"));
-    file.seekg(0, std::ios::beg);
-
-    const size_t bufferSize = 1024 * 1024;
-    std::vector<char> buffer(bufferSize);
-    size_t totalBytesRead = 0;
-    const size_t overlapSize = 70;
-    IO::Debug(t("using_buffer_size") + ": " + std::to_string(bufferSize) + " " + t("bytes") + " " + t("with_overlap") + ": " + std::to_string(overlapSize));
-
-    while (totalBytesRead < static_cast<size_t>(fileSize))
-    {
-        size_t bytesToRead = std::min(bufferSize - overlapSize,
-                                      static_cast<size_t>(fileSize) - totalBytesRead);
-        if (totalBytesRead > 0)
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
+    const char *data = reinterpret_cast<const char *>(file.data());
+    const size_t fileSize = file.size();
+    IO_DEBUG(t("file_size") + ": " + std::to_string(fileSize) + " " + t("bytes"));
+
+    // The hash sits in a script or configuration file, so the small files
+    // of an ext4 filesystem are searched first and the whole image only if
+    // they hold none or the layout is not understood.
+    std::vector<IMAGE_LAYOUT::RANGE> ranges;
+    size_t files = 0;
+    if (IMAGE_LAYOUT::smallFileRanges(file.data(), fileSize, ranges, files))
+    {
+        size_t scanned = 0;
+        for (const IMAGE_LAYOUT::RANGE &range : ranges)
         {
-            std::memmove(buffer.data(), buffer.data() + bufferSize - overlapSize, overlapSize);
-            file.read(buffer.data() + overlapSize, bytesToRead);
-            bytesToRead += overlapSize;
+            scanRange(data, range.offset, range.offset + range.length, positions);
+            scanned += range.length;
         }
-        else
-            file.read(buffer.data(), bytesToRead);
-        if (!file && file.gcount() == 0)
-            break;
-        bytesToRead = file.gcount() + (totalBytesRead > 0 ? overlapSize : 0);
-
-        for (size_t i = 0; i < bytesToRead - overlapSize; i++)
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+        IO_DEBUG(t("filesystem_search_scanned") + ": " + std::to_string(files) + " " + t("files") + ", " + std::to_string(scanned) + " " + t("bytes"));
+        if (!positions.empty())
         {
-            if (buffer[i] == '#' && i + 67 <= bytesToRead &&
-                isValidHashSequence(buffer.data(), i + 1, bytesToRead, 64) &&
-                buffer[i + 65] == ' ' && buffer[i + 66] == ' ' && buffer[i + 67] == '-')
-            {
-                size_t absolutePos = totalBytesRead + i + 1 - (totalBytesRead > 0 ? overlapSize : 0);
-                IO::Debug(t("found_sha256_hash_at") + ": " + std::to_string(absolutePos));
-                positions.push_back({absolutePos, 64});
-            }
-            if (buffer[i] == '=' && i + 38 <= bytesToRead && buffer[i + 1] == ' ' && buffer[i + 2] == '"' &&
-                isValidHashSequence(buffer.data(), i + 3, bytesToRead, 32) &&
-                buffer[i + 35] == ' ' && buffer[i + 36] == ' ' && buffer[i + 37] == '-' && buffer[i + 38] == '"')
-            {
-                size_t absolutePos = totalBytesRead + i + 3 - (totalBytesRead > 0 ? overlapSize : 0);
-                IO::Debug(t("found_md5_hash_at") + ": " + std::to_string(absolutePos));
-                positions.push_back({absolutePos, 32});
-            }
+            method = t("locate_method_filesystem");
+            IO_DEBUG(t("hash_pattern_search_completed") + " " + std::to_string(positions.size()) + " " + t("patterns"));
+            return positions;
         }
-
-        totalBytesRead += bytesToRead - (totalBytesRead > 0 ? overlapSize : 0);
     }
-    file.close();
-    IO::Debug(t("hash_pattern_search_completed") + " " + std::to_string(positions.size()) + " " + t("patterns"));
+
+    method = t("locate_method_full_scan");
+    scanRange(data, 0, fileSize, positions);
+    IO_DEBUG(t("hash_pattern_search_completed") + " " + std::to_string(positions.size()) + " " + t("patterns"));
     return positions;
 }
-bool HASH::isValidHashSequence(const char *data, size_t pos, size_t dataSize, size_t hashLength)
+void HASH::scanRange(const char *data, size_t start, size_t end, std::vector<std::pair<size_t, size_t>> &positions)
 {
-    if (pos + hashLength > dataSize)
-        return false;
-    for (size_t i = 0; i < hashLength; ++i)
-    {
-        if (!isHexChar(data[pos + i]))
-            return false;
-    }
-    return true;
+    PATTERN_SCANNER::configured().scan(data, start, end, end, [&](const PATTERN_SCANNER::MATCH &match)
+                                       { positions.push_back({match.offset, match.length}); });
 }
 std::string HASH::toHex(const unsigned char *data, size_t length)
 {
@@ -112,6 +91,34 @@ std::string HASH::toHex(const unsigned char *data, size_t length)
     return hexString;
 }
 
+struct HASH::STREAM::CONTEXT
+{
+    picohash_ctx_t md5;
+    picohash_ctx_t sha1;
+};
+
+HASH::STREAM::STREAM(bool withSha1) : context(new CONTEXT), withSha1(withSha1)
+{
+    picohash_init_md5(&context->md5);
+    picohash_init_sha1(&context->sha1);
+}
+HASH::STREAM::~STREAM() = default;
+void HASH::STREAM::update(const void *data, size_t length)
+{
+    picohash_update(&context->md5, data, length);
+    if (withSha1)
+        picohash_update(&context->sha1, data, length);
+}
+void HASH::STREAM::finish(std::string &md5, std::string &sha1)
+{
+    unsigned char md5Digest[PICOHASH_MD5_DIGEST_LENGTH];
+    unsigned char sha1Digest[PICOHASH_SHA1_DIGEST_LENGTH];
+    picohash_final(&context->md5, md5Digest);
+    picohash_final(&context->sha1, sha1Digest);
+    md5 = toHex(md5Digest, PICOHASH_MD5_DIGEST_LENGTH);
+    sha1 = withSha1 ? toHex(sha1Digest, PICOHASH_SHA1_DIGEST_LENGTH) : "";
+}
+
 std::string HASH::MD5(const std::string &input)
 {
     picohash_ctx_t ctx;
@@ -121,95 +128,92 @@ std::string HASH::MD5(const std::string &input)
     picohash_final(&ctx, digest);
     return toHex(digest, PICOHASH_MD5_DIGEST_LENGTH);
 }
+std::string HASH::MD5Buffer(const void *data, size_t length)
+{
+    picohash_ctx_t ctx;
+    unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
+    picohash_init_md5(&ctx);
+    picohash_update(&ctx, data, length);
+    picohash_final(&ctx, digest);
+    return toHex(digest, PICOHASH_MD5_DIGEST_LENGTH);
+}
 std::string HASH::MD5File(const std::string &filename)
 {
-    IO::Debug(t("calculating_md5_for_file") + ": " + filename);
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open())
-        DIE(t("cannot_open_file") + ": " + filename);
+    TRACE::SCOPE scope("md5", "hash");
+    IO_DEBUG(t("calculating_md5_for_file") + ": " + filename);
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
 
-    const size_t bufferSize = 1024 * 1024;
-    std::vector<char> buffer(bufferSize);
+    picohash_ctx_t ctx;
+    picohash_init_md5(&ctx);
+    picohash_update(&ctx, file.data(), file.size());
+    unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
+    picohash_final(&ctx, digest);
+    std::string result = toHex(digest, PICOHASH_MD5_DIGEST_LENGTH);
+    IO_DEBUG(t("md5_calculated_for") + " " + std::to_string(file.size()) + " " + t("bytes") + ": " + result);
+    return result;
+}
+std::string HASH::MD5CopyFile(const std::string &source, const std::string &destination)
+{
+    TRACE::SCOPE scope("copy with md5", "hash");
+    IO_DEBUG(t("copying_file_with_md5") + ": " + source + " -> " + destination);
+    MAPPED_FILE input(source, MAPPED_FILE::READ);
+    MAPPED_FILE output(destination, input.size(), true);
 
+    // Copy and hash one stride at a time so each page is touched while it
+    // is still in the CPU cache. Zero blocks, plentiful in a filesystem
+    // image, are left as holes in the sparse copy.
+    const size_t strideSize = 1024 * 1024;
+    const size_t blockSize = 64 * 1024;
+    static const unsigned char zeros[blockSize] = {};
     picohash_ctx_t ctx;
     picohash_init_md5(&ctx);
-    size_t totalBytes = 0;
-    while (true)
+    for (size_t offset = 0; offset < input.size(); offset += strideSize)
     {
-        file.read(buffer.data(), bufferSize);
-        std::streamsize bytesRead = file.gcount();
-        if (bytesRead <= 0)
-            break;
-        picohash_update(&ctx, buffer.data(), static_cast<size_t>(bytesRead));
-        totalBytes += static_cast<size_t>(bytesRead);
+        const size_t count = std::min(strideSize, input.size() - offset);
+        for (size_t block = offset; block < offset + count; block += blockSize)
+        {
+            const size_t length = std::min(blockSize, offset + count - block);
+            if (std::memcmp(input.data() + block, zeros, length) != 0)
+                std::memcpy(output.data() + block, input.data() + block, length);
+        }
+        picohash_update(&ctx, input.data() + offset, count);
     }
     unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
     picohash_final(&ctx, digest);
-    file.close();
     std::string result = toHex(digest, PICOHASH_MD5_DIGEST_LENGTH);
-    IO::Debug(t("md5_calculated_for") + " " + std::to_string(totalBytes) + " " + t("bytes") + ": " + result);
+    IO_DEBUG(t("md5_calculated_for") + " " + std::to_string(input.size()) + " " + t("bytes") + ": " + result);
     return result;
 }
 std::string HASH::MD5FileSegment(const std::string &filename, size_t start, size_t end)
 {
-    IO::Debug(t("calculating_md5_segment") + ": " + filename + " [" + std::to_string(start) + "-" + std::to_string(end) + "]");
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open())
-        DIE(t("cannot_open_file") + ": " + filename);
-
-    const size_t bufferSize = 1024 * 1024;
-    std::vector<char> buffer(bufferSize);
+    TRACE::SCOPE scope("segment md5", "hash");
+    IO_DEBUG(t("calculating_md5_segment") + ": " + filename + " [" + std::to_string(start) + "-" + std::to_string(end) + "]");
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
+    start = std::min(start, file.size());
+    end = std::max(start, std::min(end, file.size()));
 
     picohash_ctx_t ctx;
     picohash_init_md5(&ctx);
-    file.seekg(start, std::ios::beg);
-    size_t currentPos = start;
-    size_t totalProcessed = 0;
-    while (currentPos < end)
-    {
-        size_t bytesToRead = std::min(bufferSize, end - currentPos);
-        file.read(buffer.data(), bytesToRead);
-        std::streamsize bytesRead = file.gcount();
-        if (bytesRead <= 0)
-            break;
-        picohash_update(&ctx, buffer.data(), bytesRead);
-        currentPos += bytesRead;
-        totalProcessed += bytesRead;
-    }
+    picohash_update(&ctx, file.data() + start, end - start);
     unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
     picohash_final(&ctx, digest);
-    file.close();
     std::string result = toHex(digest, PICOHASH_MD5_DIGEST_LENGTH);
-    IO::Debug(t("segment_md5_calculated") + " " + std::to_string(totalProcessed) + " " + t("bytes") + ": " + result);
+    IO_DEBUG(t("segment_md5_calculated") + " " + std::to_string(end - start) + " " + t("bytes") + ": " + result);
     return result;
 }
 std::string HASH::SHA1File(const std::string &filename)
 {
-    IO::Debug(t("calculating_sha1_for_file") + ": " + filename);
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open())
-        DIE(t("cannot_open_file") + ": " + filename);
-
-    const size_t bufferSize = 1024 * 1024;
-    std::vector<char> buffer(bufferSize);
+    TRACE::SCOPE scope("sha1", "hash");
+    IO_DEBUG(t("calculating_sha1_for_file") + ": " + filename);
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
 
     picohash_ctx_t ctx;
     picohash_init_sha1(&ctx);
-    size_t totalBytes = 0;
-    while (true)
-    {
-        file.read(buffer.data(), bufferSize);
-        std::streamsize bytesRead = file.gcount();
-        if (bytesRead <= 0)
-            break;
-        picohash_update(&ctx, buffer.data(), static_cast<size_t>(bytesRead));
-        totalBytes += static_cast<size_t>(bytesRead);
-    }
+    picohash_update(&ctx, file.data(), file.size());
     unsigned char digest[PICOHASH_SHA1_DIGEST_LENGTH];
     picohash_final(&ctx, digest);
-    file.close();
     std::string result = toHex(digest, PICOHASH_SHA1_DIGEST_LENGTH);
-    IO::Debug(t("sha1_calculated_for") + " " + std::to_string(totalBytes) + " " + t("bytes") + ": " + result);
+    IO_DEBUG(t("sha1_calculated_for") + " " + std::to_string(file.size()) + " " + t("bytes") + ": " + result);
     return result;
 }
 std::string HASH::SHA256(const std::string &input)
@@ -221,18 +225,97 @@ std::string HASH::SHA256(const std::string &input)
     picohash_final(&ctx, digest);
     return toHex(digest, PICOHASH_SHA256_DIGEST_LENGTH);
 }
+void HASH::digestPatched(const std::string &filename, const std::vector<PATCH> &patches, nlohmann::json &segmentMd5,
+                         std::string &md5, std::string &sha1, std::string &pristineMd5)
+{
+    TRACE::SCOPE scope("patched digests", "hash");
+    IO_DEBUG(t("calculating_patched_digests") + ": " + filename);
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
+    const size_t size = file.size();
+
+    struct RANGE
+    {
+        size_t start;
+        size_t end;
+        std::unique_ptr<STREAM> digest;
+    };
+    std::vector<RANGE> segments;
+    for (const auto &segment : segmentMd5)
+    {
+        const size_t end = std::min(segment["endpos"].get<size_t>(), size);
+        segments.push_back({std::min(segment["startpos"].get<size_t>(), end), end, std::unique_ptr<STREAM>(new STREAM(false))});
+    }
+
+    // Each stride is patched in a private buffer, then fed to every digest
+    // it overlaps while it is still in the CPU cache.
+    const size_t strideSize = 1024 * 1024;
+    std::vector<unsigned char> stride(strideSize);
+    STREAM served, pristine(false);
+    for (size_t offset = 0; offset < size; offset += strideSize)
+    {
+        const size_t count = std::min(strideSize, size - offset);
+        pristine.update(file.data() + offset, count);
+        std::memcpy(stride.data(), file.data() + offset, count);
+        for (const PATCH &patch : patches)
+        {
+            const size_t begin = std::max(offset, patch.offset);
+            const size_t end = std::min(offset + count, patch.offset + patch.bytes.size());
+            if (begin < end)
+                std::memcpy(stride.data() + (begin - offset), patch.bytes.data() + (begin - patch.offset), end - begin);
+        }
+        served.update(stride.data(), count);
+        for (RANGE &segment : segments)
+        {
+            const size_t begin = std::max(offset, segment.start);
+            const size_t end = std::min(offset + count, segment.end);
+            if (begin < end)
+                segment.digest->update(stride.data() + (begin - offset), end - begin);
+        }
+    }
+
+    std::string unused;
+    served.finish(md5, sha1);
+    pristine.finish(pristineMd5, unused);
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        std::string segmentDigest;
+        segments[i].digest->finish(segmentDigest, unused);
+        segmentMd5[i]["md5"] = segmentDigest;
+    }
+    IO_DEBUG(t("md5_calculated_for") + " " + std::to_string(size) + " " + t("bytes") + ": " + md5);
+}
 
-void HASH::replaceHash(const std::string &filename)
+std::string HASH::readNewPassword()
 {
-    IO::Info(t("finding_password"));
-    IO::Debug(t("starting_password_search") + ": " + filename);
-    const std::vector<std::pair<size_t, size_t>> positions = HASH::findHashPatterns(filename);
-    if (positions.empty())
-        DIE(t("no_passwords_found"));
-    if (positions.size() > 1)
-        DIE(t("multiple_password_patterns"));
-    IO::Debug(t("found_password_at_offset") + " " + std::to_string(positions[0].first));
-    IO::Debug(t("hash_length") + ": " + std::to_string(positions[0].second) + " " + t("characters"));
+    TRACE::SCOPE scope("password input", "operator");
+    if (ARGC::HasArg("password"))
+        return ARGC::GetArg("password");
+    const std::string passwordFile = ARGC::GetArg("password-file");
+    if (!passwordFile.empty())
+    {
+        // One line per pen, in the order they are captured; the last line
+        // is reused once the file runs out.
+        static std::vector<std::string> passwords;
+        static size_t next = 0;
+        if (passwords.empty())
+        {
+            std::ifstream file(passwordFile);
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (!line.empty())
+                    passwords.push_back(line);
+            }
+            if (passwords.empty())
+                DIE(t("password_file_empty") + ": " + passwordFile);
+        }
+        return passwords[std::min(next++, passwords.size() - 1)];
+    }
+    if (ARGC::HasArg("batch"))
+        DIE(t("batch_requires_password"));
+
     std::string newPassword;
     while (newPassword == "")
     {
@@ -240,14 +323,209 @@ void HASH::replaceHash(const std::string &filename)
         if (newPassword == "")
             IO::Warn(t("password_cannot_be_empty"));
     }
-    IO::Debug(t("generating_hash_for_password"));
-    const std::string newHash = (positions[0].second == 32 ? HASH::MD5(newPassword + '\n') : HASH::SHA256(newPassword));
-    IO::Debug(t("new_hash_generated") + ": " + newHash);
-    FILE *file = fopen(filename.c_str(), "r+b");
-    if (!file)
-        DIE(t("cannot_open_file") + ": " + filename);
-    fseek(file, positions[0].first, SEEK_SET);
-    fwrite(newHash.c_str(), 1, newHash.size(), file);
-    fclose(file);
-    IO::Debug(t("password_hash_replacement_completed"));
+    return newPassword;
+}
+std::string HASH::hashForPassword(const std::string &password, const std::string &record)
+{
+    IO_DEBUG(t("generating_hash_for_password"));
+    std::string newHash;
+    switch (PATTERN_SCANNER::identify(record))
+    {
+    case PATTERN_SCANNER::SHA256SUM:
+        newHash = HASH::SHA256(password);
+        break;
+    case PATTERN_SCANNER::MD5SUM:
+        newHash = HASH::MD5(password + '\n');
+        break;
+    case PATTERN_SCANNER::MD5_CRYPT:
+    {
+        // The salt is kept, so the record keeps its length.
+        const size_t saltEnd = record.find('$', 3);
+        newHash = md5Crypt(password, record.substr(3, saltEnd - 3));
+        break;
+    }
+    case PATTERN_SCANNER::SHA256_CRYPT:
+    {
+        const size_t hashStart = record.rfind('$');
+        newHash = sha256Crypt(password, record.substr(3, hashStart - 3));
+        break;
+    }
+    default:
+        DIE(t("sha512_crypt_unsupported"));
+    }
+    if (newHash.length() != record.length())
+        DIE(t("password_record_length_changed") + ": " + record);
+    IO_DEBUG(t("new_hash_generated") + ": " + newHash);
+    return newHash;
+}
+HASH::PATCH HASH::patchFor(const std::string &filename, std::pair<size_t, size_t> position, const std::string &password)
+{
+    std::string record;
+    {
+        MAPPED_FILE file(filename, MAPPED_FILE::READ);
+        record.assign(reinterpret_cast<const char *>(file.data()) + position.first, position.second);
+    }
+    return {position.first, hashForPassword(password, record)};
+}
+std::string HASH::cryptBase64(const unsigned char *digest, const std::vector<std::array<int, 3>> &groups)
+{
+    // crypt's own base64: least significant six bits first, with an
+    // alphabet that starts at '.'; -1 stands for a zero byte.
+    static const char alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::string encoded;
+    for (const auto &group : groups)
+    {
+        uint32_t value = 0;
+        int characters = 1;
+        for (int index : group)
+        {
+            value = value << 8 | (index < 0 ? 0 : digest[index]);
+            characters += index < 0 ? 0 : 1;
+        }
+        for (int i = 0; i < characters; i++, value >>= 6)
+            encoded += alphabet[value & 0x3f];
+    }
+    return encoded;
+}
+std::string HASH::md5Crypt(const std::string &password, const std::string &salt)
+{
+    // The FreeBSD MD5-based crypt, as used in /etc/shadow.
+    unsigned char digest[PICOHASH_MD5_DIGEST_LENGTH];
+    picohash_ctx_t ctx;
+    picohash_init_md5(&ctx);
+    picohash_update(&ctx, (password + salt + password).data(), password.size() * 2 + salt.size());
+    picohash_final(&ctx, digest);
+
+    picohash_init_md5(&ctx);
+    picohash_update(&ctx, (password + "$1$" + salt).data(), password.size() + 3 + salt.size());
+    for (size_t left = password.size(); left > 0; left -= std::min(left, size_t(PICOHASH_MD5_DIGEST_LENGTH)))
+        picohash_update(&ctx, digest, std::min(left, size_t(PICOHASH_MD5_DIGEST_LENGTH)));
+    for (size_t bits = password.size(); bits > 0; bits >>= 1)
+        picohash_update(&ctx, (bits & 1) ? "" : password.data(), 1);
+    picohash_final(&ctx, digest);
+
+    for (int round = 0; round < 1000; round++)
+    {
+        picohash_init_md5(&ctx);
+        if (round & 1)
+            picohash_update(&ctx, password.data(), password.size());
+        else
+            picohash_update(&ctx, digest, PICOHASH_MD5_DIGEST_LENGTH);
+        if (round % 3)
+            picohash_update(&ctx, salt.data(), salt.size());
+        if (round % 7)
+            picohash_update(&ctx, password.data(), password.size());
+        if (round & 1)
+            picohash_update(&ctx, digest, PICOHASH_MD5_DIGEST_LENGTH);
+        else
+            picohash_update(&ctx, password.data(), password.size());
+        picohash_final(&ctx, digest);
+    }
+    return "$1$" + salt + "$" + cryptBase64(digest, {{0, 6, 12}, {1, 7, 13}, {2, 8, 14}, {3, 9, 15}, {4, 10, 5}, {-1, -1, 11}});
+}
+std::string HASH::sha256Crypt(const std::string &password, const std::string &setting)
+{
+    // Drepper's SHA-256 crypt. setting is "[rounds=N$]salt" and is written
+    // back unchanged, like glibc does for an in-range round count.
+    size_t rounds = 5000;
+    std::string salt = setting;
+    if (setting.compare(0, 7, "rounds=") == 0)
+    {
+        const size_t dollar = setting.find('$');
+        rounds = std::min<size_t>(std::max<size_t>(std::stoul(setting.substr(7, dollar - 7)), 1000), 999999999);
+        salt = setting.substr(dollar + 1);
+    }
+    salt = salt.substr(0, 16);
+    const size_t length = password.size();
+    unsigned char alternate[PICOHASH_SHA256_DIGEST_LENGTH], digest[PICOHASH_SHA256_DIGEST_LENGTH];
+    picohash_ctx_t ctx;
+    picohash_init_sha256(&ctx);
+    picohash_update(&ctx, (password + salt + password).data(), length * 2 + salt.size());
+    picohash_final(&ctx, alternate);
+
+    picohash_init_sha256(&ctx);
+    picohash_update(&ctx, (password + salt).data(), length + salt.size());
+    size_t left = length;
+    for (; left > PICOHASH_SHA256_DIGEST_LENGTH; left -= PICOHASH_SHA256_DIGEST_LENGTH)
+        picohash_update(&ctx, alternate, PICOHASH_SHA256_DIGEST_LENGTH);
+    picohash_update(&ctx, alternate, left);
+    for (size_t bits = length; bits > 0; bits >>= 1)
+        if (bits & 1)
+            picohash_update(&ctx, alternate, PICOHASH_SHA256_DIGEST_LENGTH);
+        else
+            picohash_update(&ctx, password.data(), length);
+    picohash_final(&ctx, digest);
+
+    // P and S sequences: digests of the password and salt repeated, cut
+    // to the original lengths.
+    unsigned char sequence[PICOHASH_SHA256_DIGEST_LENGTH];
+    picohash_init_sha256(&ctx);
+    for (size_t i = 0; i < length; i++)
+        picohash_update(&ctx, password.data(), length);
+    picohash_final(&ctx, sequence);
+    std::string p(length, '\0');
+    for (size_t i = 0; i < length; i++)
+        p[i] = sequence[i % PICOHASH_SHA256_DIGEST_LENGTH];
+    picohash_init_sha256(&ctx);
+    for (size_t i = 0; i < 16u + digest[0]; i++)
+        picohash_update(&ctx, salt.data(), salt.size());
+    picohash_final(&ctx, sequence);
+    const std::string s(reinterpret_cast<const char *>(sequence), salt.size());
+
+    for (size_t round = 0; round < rounds; round++)
+    {
+        picohash_init_sha256(&ctx);
+        if (round & 1)
+            picohash_update(&ctx, p.data(), p.size());
+        else
+            picohash_update(&ctx, digest, PICOHASH_SHA256_DIGEST_LENGTH);
+        if (round % 3)
+            picohash_update(&ctx, s.data(), s.size());
+        if (round % 7)
+            picohash_update(&ctx, p.data(), p.size());
+        if (round & 1)
+            picohash_update(&ctx, digest, PICOHASH_SHA256_DIGEST_LENGTH);
+        else
+            picohash_update(&ctx, p.data(), p.size());
+        picohash_final(&ctx, digest);
+    }
+    return "$5$" + setting + "$" +
+           cryptBase64(digest, {{0, 10, 20}, {21, 1, 11}, {12, 22, 2}, {3, 13, 23}, {24, 4, 14}, {15, 25, 5}, {6, 16, 26}, {27, 7, 17}, {18, 28, 8}, {9, 19, 29}, {-1, 31, 30}});
+}
+bool HASH::hintMatches(const std::string &filename, size_t hintOffset, size_t hintLength)
+{
+    if (hintLength == 0)
+        return false;
+    MAPPED_FILE file(filename, MAPPED_FILE::READ);
+    if (hintOffset >= file.size())
+        return false;
+    // Only the anchors that could lead up to the hinted record are looked at.
+    bool matches = false;
+    PATTERN_SCANNER::configured().scan(reinterpret_cast<const char *>(file.data()), hintOffset - std::min(hintOffset, PATTERN_SCANNER::MAX_LEAD),
+                                       hintOffset + 1, file.size(), [&](const PATTERN_SCANNER::MATCH &match)
+                                       { matches = matches || (match.offset == hintOffset && match.length == hintLength); });
+    return matches;
+}
+std::pair<size_t, size_t> HASH::locatePassword(const std::string &filename, size_t hintOffset, size_t hintLength)
+{
+    TRACE::SCOPE scope("locate password");
+    IO::Info(t("finding_password"));
+    IO_DEBUG(t("starting_password_search") + ": " + filename);
+    std::vector<std::pair<size_t, size_t>> positions;
+    std::string method;
+    if (hintMatches(filename, hintOffset, hintLength))
+    {
+        method = t("locate_method_hint");
+        positions.push_back({hintOffset, hintLength});
+    }
+    else
+        positions = HASH::findHashPatterns(filename, method);
+    IO::Info(t("password_search_method") + ": " + method);
+    if (positions.empty())
+        DIE(t("no_passwords_found"));
+    if (positions.size() > 1)
+        DIE(t("multiple_password_patterns"));
+    IO_DEBUG(t("found_password_at_offset") + " " + std::to_string(positions[0].first));
+    IO_DEBUG(t("hash_length") + ": " + std::to_string(positions[0].second) + " " + t("characters"));
+    return positions[0];
 }
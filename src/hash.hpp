@@ -19,21 +19,65 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <array>
+#include "json.hpp"
 
 class HASH
 {
 private:
-    static bool isHexChar(char c);
-    static std::vector<std::pair<size_t, size_t>> findHashPatterns(const std::string &filename);
-    static bool isValidHashSequence(const char *data, size_t pos, size_t dataSize, size_t hashLength);
     static std::string toHex(const unsigned char *data, size_t length);
+    static void scanRange(const char *data, size_t start, size_t end, std::vector<std::pair<size_t, size_t>> &positions);
+    static bool hintMatches(const std::string &filename, size_t hintOffset, size_t hintLength);
+    static std::string cryptBase64(const unsigned char *digest, const std::vector<std::array<int, 3>> &groups);
+    static std::string md5Crypt(const std::string &password, const std::string &salt);
+    static std::string sha256Crypt(const std::string &password, const std::string &setting);
 
 public:
+    // Bytes that replace part of an image without touching the file.
+    struct PATCH
+    {
+        size_t offset = 0;
+        std::string bytes;
+    };
+
+    // Incremental MD5 and SHA-1 over the same bytes, fed as they arrive.
+    class STREAM
+    {
+    public:
+        explicit STREAM(bool withSha1 = true);
+        ~STREAM();
+        void update(const void *data, size_t length);
+        void finish(std::string &md5, std::string &sha1);
+
+    private:
+        struct CONTEXT;
+        std::unique_ptr<CONTEXT> context;
+        bool withSha1;
+    };
+
     static std::string MD5(const std::string &input);
+    static std::string MD5Buffer(const void *data, size_t length);
     static std::string MD5File(const std::string &filename);
+    static std::string MD5CopyFile(const std::string &source, const std::string &destination);
     static std::string MD5FileSegment(const std::string &filename, size_t start, size_t end);
     static std::string SHA1File(const std::string &filename);
     static std::string SHA256(const std::string &input);
+    // Digests of the image as served, with patches applied over the file,
+    // in one pass; pristineMd5 is the digest of the file itself.
+    static void digestPatched(const std::string &filename, const std::vector<PATCH> &patches, nlohmann::json &segmentMd5,
+                              std::string &md5, std::string &sha1, std::string &pristineMd5);
 
-    static void replaceHash(const std::string &filename);
+    static std::vector<std::pair<size_t, size_t>> findHashPatterns(const std::string &filename);
+    // method tells how the returned positions were found.
+    static std::vector<std::pair<size_t, size_t>> findHashPatterns(const std::string &filename, std::string &method);
+    static std::string readNewPassword();
+    // A record of the same format and length as the one found, for the
+    // new password; crypt records keep their salt and round count.
+    static std::string hashForPassword(const std::string &password, const std::string &record);
+    static PATCH patchFor(const std::string &filename, std::pair<size_t, size_t> position, const std::string &password);
+    // Offset and length of the single password hash; dies on none or many.
+    // A hint (offset and length of a pre-scanned hash) skips the search
+    // when it still matches.
+    static std::pair<size_t, size_t> locatePassword(const std::string &filename, size_t hintOffset = 0, size_t hintLength = 0);
 };
@@ -30,11 +30,11 @@ const std::string HOST::HOSTS_FILE_PATH = "C:\\Windows\\System32\\drivers\\etc\\
 
 bool HOST::ReadHostsFile(std::vector<std::string> &lines)
 {
-    IO::Debug(t("opening_hosts_file") + ": " + HOSTS_FILE_PATH);
+    IO_DEBUG(t("opening_hosts_file") + ": " + HOSTS_FILE_PATH);
     std::ifstream file(HOSTS_FILE_PATH);
     if (!file.is_open())
         DIE(t("cannot_open_hosts_file"));
-    IO::Debug(t("reading_hosts_file"));
+    IO_DEBUG(t("reading_hosts_file"));
     std::string line;
     while (std::getline(file, line))
         lines.push_back(line);
@@ -44,14 +44,14 @@ bool HOST::ReadHostsFile(std::vector<std::string> &lines)
 
 bool HOST::WriteHostsFile(const std::vector<std::string> &lines)
 {
-    IO::Debug(t("writing_hosts_file"));
+    IO_DEBUG(t("writing_hosts_file"));
     std::ofstream file(HOSTS_FILE_PATH);
     if (!file.is_open())
         DIE(t("failed_write_hosts_file"));
     for (const auto &line : lines)
         file << line << std::endl;
     file.close();
-    IO::Debug(t("hosts_file_updated"));
+    IO_DEBUG(t("hosts_file_updated"));
     return true;
 }
 
@@ -77,8 +77,8 @@ void HOST::RemoveHostEntry(std::vector<std::string> &lines)
 }
 void HOST::FlushDnsCache()
 {
-    IO::Debug(t("flushing_dns_cache"));
-    IO::Debug(t("loading_dnsapi_dll"));
+    IO_DEBUG(t("flushing_dns_cache"));
+    IO_DEBUG(t("loading_dnsapi_dll"));
     HMODULE hDnsApi = LoadLibraryA("dnsapi.dll");
     if (hDnsApi == NULL)
         DIE(t("failed_load_dnsapi"));
@@ -94,12 +94,12 @@ void HOST::FlushDnsCache()
     FreeLibrary(hDnsApi);
     if (!result)
         DIE(t("failed_flush_dns_cache"));
-    IO::Debug(t("dns_cache_flushed"));
+    IO_DEBUG(t("dns_cache_flushed"));
 }
 
 void HOST::enable()
 {
-    IO::Debug(t("enabling_host_redirect"));
+    IO_DEBUG(t("enabling_host_redirect"));
     std::vector<std::string> lines;
     ReadHostsFile(lines);
     if (ContainsHostEntry(lines))
@@ -107,7 +107,7 @@ void HOST::enable()
         IO::Warn(t("host_entry_already_exists"));
         return;
     }
-    IO::Debug(t("adding_host_entry") + ": " + HOST_ENTRY);
+    IO_DEBUG(t("adding_host_entry") + ": " + HOST_ENTRY);
     lines.push_back(HOST_ENTRY);
     WriteHostsFile(lines);
     IO::Info(t("host_entry_added"));
@@ -116,7 +116,7 @@ void HOST::enable()
 
 void HOST::disable()
 {
-    IO::Debug(t("disabling_host_redirect"));
+    IO_DEBUG(t("disabling_host_redirect"));
     std::vector<std::string> lines;
     ReadHostsFile(lines);
     if (!ContainsHostEntry(lines))
@@ -124,7 +124,7 @@ void HOST::disable()
         IO::Warn(t("host_entry_not_found"));
         return;
     }
-    IO::Debug(t("removing_host_entry"));
+    IO_DEBUG(t("removing_host_entry"));
     RemoveHostEntry(lines);
     WriteHostsFile(lines);
     IO::Info(t("host_entry_removed"));
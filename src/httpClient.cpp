@@ -0,0 +1,485 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "httpClient.hpp"
+#include "i18n.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define INVALID_SOCKET (-1)
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+std::string HTTP_CLIENT::RESPONSE::getHeader(const std::string &name) const
+{
+    auto it = headers.find(name);
+    return it == headers.end() ? "" : it->second;
+}
+
+static std::string toLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return value;
+}
+
+static std::string trim(const std::string &value)
+{
+    const size_t begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    return value.substr(begin, value.find_last_not_of(" \t") - begin + 1);
+}
+
+HTTP_CLIENT::HTTP_CLIENT(int timeoutMs) : timeoutMs(timeoutMs)
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+}
+
+HTTP_CLIENT::~HTTP_CLIENT()
+{
+    for (auto &[key, connection] : idleConnections)
+        closeSocket(connection.socket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool HTTP_CLIENT::parseUrl(const std::string &url, std::string &host, std::string &port, std::string &path)
+{
+    const std::string scheme = "http://";
+    if (toLower(url.substr(0, scheme.length())) != scheme)
+        return false;
+    const size_t authorityEnd = url.find_first_of("/?#", scheme.length());
+    const std::string authority = url.substr(scheme.length(), authorityEnd - scheme.length());
+    path = authorityEnd == std::string::npos ? "/" : url.substr(authorityEnd);
+    if (path[0] != '/')
+        path = "/" + path;
+    const size_t fragment = path.find('#');
+    if (fragment != std::string::npos)
+        path.erase(fragment);
+
+    port = "80";
+    if (!authority.empty() && authority[0] == '[')
+    {
+        const size_t close = authority.find(']');
+        if (close == std::string::npos)
+            return false;
+        host = authority.substr(1, close - 1);
+        if (close + 1 < authority.length() && authority[close + 1] == ':')
+            port = authority.substr(close + 2);
+    }
+    else
+    {
+        const size_t colon = authority.find(':');
+        host = authority.substr(0, colon);
+        if (colon != std::string::npos)
+            port = authority.substr(colon + 1);
+    }
+    return !host.empty() && !port.empty() &&
+           std::all_of(port.begin(), port.end(), [](unsigned char c)
+                       { return std::isdigit(c); });
+}
+
+void HTTP_CLIENT::closeSocket(SOCKET_HANDLE socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+bool HTTP_CLIENT::pinHost(const std::string &host, std::string &error)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &addresses) != 0 || !addresses)
+    {
+        error = t("http_resolve_failed") + ": " + host;
+        return false;
+    }
+    char numeric[NI_MAXHOST];
+    const bool converted = getnameinfo(addresses->ai_addr, static_cast<socklen_t>(addresses->ai_addrlen),
+                                       numeric, sizeof(numeric), NULL, 0, NI_NUMERICHOST) == 0;
+    freeaddrinfo(addresses);
+    if (!converted)
+    {
+        error = t("http_resolve_failed") + ": " + host;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(poolMutex);
+    pinnedHosts[host] = numeric;
+    return true;
+}
+
+HTTP_CLIENT::SOCKET_HANDLE HTTP_CLIENT::connectTo(const std::string &host, const std::string &port, std::string &error)
+{
+    std::string address = host;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        auto pinned = pinnedHosts.find(host);
+        if (pinned != pinnedHosts.end())
+            address = pinned->second;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(address.c_str(), port.c_str(), &hints, &addresses) != 0 || !addresses)
+    {
+        error = t("http_resolve_failed") + ": " + host;
+        return INVALID_SOCKET;
+    }
+
+    SOCKET_HANDLE result = INVALID_SOCKET;
+    for (addrinfo *address = addresses; address && result == INVALID_SOCKET; address = address->ai_next)
+    {
+        SOCKET_HANDLE candidate = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (candidate == INVALID_SOCKET)
+            continue;
+
+        // Connect without blocking so the handshake honours the timeout.
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(candidate, FIONBIO, &nonBlocking);
+        const bool pending = connect(candidate, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0 &&
+                             WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        const int flags = fcntl(candidate, F_GETFL, 0);
+        fcntl(candidate, F_SETFL, flags | O_NONBLOCK);
+        const bool pending = connect(candidate, address->ai_addr, address->ai_addrlen) != 0 && errno == EINPROGRESS;
+#endif
+        bool connected = !pending;
+        if (pending)
+        {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(candidate, &writable);
+            timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+            int socketError = 0;
+            socklen_t errorLength = sizeof(socketError);
+            connected = select(static_cast<int>(candidate + 1), NULL, &writable, NULL, &timeout) == 1 &&
+                        getsockopt(candidate, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&socketError), &errorLength) == 0 &&
+                        socketError == 0;
+        }
+        if (!connected)
+        {
+            closeSocket(candidate);
+            continue;
+        }
+#ifdef _WIN32
+        u_long blocking = 0;
+        ioctlsocket(candidate, FIONBIO, &blocking);
+        DWORD sendTimeout = static_cast<DWORD>(timeoutMs);
+#else
+        fcntl(candidate, F_SETFL, flags);
+        timeval sendTimeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+#endif
+        setsockopt(candidate, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char *>(&sendTimeout), sizeof(sendTimeout));
+        int noDelay = 1;
+        setsockopt(candidate, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+        result = candidate;
+    }
+    freeaddrinfo(addresses);
+    if (result == INVALID_SOCKET)
+        error = t("http_connect_failed") + ": " + host + ":" + port;
+    return result;
+}
+
+bool HTTP_CLIENT::acquire(const std::string &host, const std::string &port, CONNECTION &connection, std::string &error)
+{
+    const std::string key = host + ":" + port;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        const auto now = std::chrono::steady_clock::now();
+        auto range = idleConnections.equal_range(key);
+        for (auto it = range.first; it != range.second;)
+        {
+            CONNECTION candidate = it->second;
+            it = idleConnections.erase(it);
+            // An idle connection with something to read has been closed
+            // (or poisoned) by the server.
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(candidate.socket, &readable);
+            timeval immediately = {0, 0};
+            if (now - candidate.idleSince > std::chrono::seconds(IDLE_TIMEOUT_SECONDS) ||
+                select(static_cast<int>(candidate.socket + 1), &readable, NULL, NULL, &immediately) != 0)
+            {
+                closeSocket(candidate.socket);
+                continue;
+            }
+            connection = candidate;
+            connection.reused = true;
+            return true;
+        }
+    }
+    connection = CONNECTION();
+    connection.socket = connectTo(host, port, error);
+    return connection.socket != INVALID_SOCKET;
+}
+
+void HTTP_CLIENT::release(const std::string &key, CONNECTION &connection)
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (idleConnections.count(key) >= MAX_IDLE_PER_HOST)
+    {
+        closeSocket(connection.socket);
+        return;
+    }
+    connection.pending.clear();
+    connection.idleSince = std::chrono::steady_clock::now();
+    idleConnections.insert({key, connection});
+}
+
+bool HTTP_CLIENT::waitReadable(SOCKET_HANDLE socket)
+{
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(socket, &readable);
+    timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    return select(static_cast<int>(socket + 1), &readable, NULL, NULL, &timeout) == 1;
+}
+
+bool HTTP_CLIENT::sendAll(CONNECTION &connection, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.length())
+    {
+        const int result = send(connection.socket, data.data() + sent, static_cast<int>(data.length() - sent), MSG_NOSIGNAL);
+        if (result <= 0)
+            return false;
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool HTTP_CLIENT::fill(CONNECTION &connection)
+{
+    if (!waitReadable(connection.socket))
+        return false;
+    char buffer[RECEIVE_BUFFER_SIZE];
+    const int received = recv(connection.socket, buffer, sizeof(buffer), 0);
+    if (received <= 0)
+        return false;
+    connection.pending.append(buffer, static_cast<size_t>(received));
+    return true;
+}
+
+bool HTTP_CLIENT::readLine(CONNECTION &connection, std::string &line)
+{
+    size_t end;
+    while ((end = connection.pending.find("\r\n")) == std::string::npos)
+        if (connection.pending.length() > RECEIVE_BUFFER_SIZE || !fill(connection))
+            return false;
+    line = connection.pending.substr(0, end);
+    connection.pending.erase(0, end + 2);
+    return true;
+}
+
+HTTP_CLIENT::OUTCOME HTTP_CLIENT::readBody(CONNECTION &connection, const std::string &method, RESPONSE &response,
+                                           BODY_CALLBACK &onBody, bool &reusable)
+{
+    auto deliver = [&](size_t count) -> bool
+    {
+        const bool accepted = onBody ? onBody(connection.pending.data(), count)
+                                     : (response.body.append(connection.pending, 0, count), true);
+        connection.pending.erase(0, count);
+        return accepted;
+    };
+    auto readExactly = [&](uint64_t remaining) -> OUTCOME
+    {
+        while (remaining > 0)
+        {
+            if (connection.pending.empty() && !fill(connection))
+                return FAILED;
+            const size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, connection.pending.length()));
+            if (!deliver(count))
+                return ABANDONED;
+            remaining -= count;
+        }
+        return COMPLETE;
+    };
+
+    if (method == "HEAD" || response.statusCode == 204 || response.statusCode == 304)
+        return COMPLETE;
+
+    if (toLower(response.getHeader("transfer-encoding")).find("chunked") != std::string::npos)
+    {
+        std::string line;
+        while (true)
+        {
+            if (!readLine(connection, line))
+                return FAILED;
+            char *end = nullptr;
+            const uint64_t chunkSize = std::strtoull(line.c_str(), &end, 16);
+            if (end == line.c_str())
+                return FAILED;
+            if (chunkSize == 0)
+                break;
+            const OUTCOME outcome = readExactly(chunkSize);
+            if (outcome != COMPLETE)
+                return outcome;
+            if (!readLine(connection, line) || !line.empty())
+                return FAILED;
+        }
+        do
+            if (!readLine(connection, line))
+                return FAILED;
+        while (!line.empty());
+        return COMPLETE;
+    }
+
+    const std::string contentLength = response.getHeader("content-length");
+    if (!contentLength.empty())
+        return readExactly(std::strtoull(contentLength.c_str(), nullptr, 10));
+
+    // No framing: the body runs until the server closes the connection.
+    reusable = false;
+    while (true)
+    {
+        if (connection.pending.empty() && !fill(connection))
+            return COMPLETE;
+        if (!deliver(connection.pending.length()))
+            return ABANDONED;
+    }
+}
+
+HTTP_CLIENT::OUTCOME HTTP_CLIENT::exchange(CONNECTION &connection, const std::string &method, const std::string &request,
+                                           RESPONSE &response, HEADERS_CALLBACK &onHeaders, BODY_CALLBACK &onBody, bool &reusable)
+{
+    if (!sendAll(connection, request))
+    {
+        response.error = t("http_send_failed");
+        return FAILED;
+    }
+
+    std::string statusLine;
+    do
+    {
+        // Interim 1xx responses carry headers of their own; skip them.
+        response.headers.clear();
+        if (!readLine(connection, statusLine))
+        {
+            response.error = t("http_no_response");
+            return FAILED;
+        }
+        const size_t space = statusLine.find(' ');
+        if (statusLine.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+        {
+            response.error = t("http_malformed_response") + ": " + statusLine;
+            return FAILED;
+        }
+        response.statusCode = std::atoi(statusLine.c_str() + space + 1);
+        std::string line;
+        while (true)
+        {
+            if (!readLine(connection, line))
+            {
+                response.error = t("http_malformed_response");
+                return FAILED;
+            }
+            if (line.empty())
+                break;
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos)
+                response.headers[toLower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+        }
+    } while (response.statusCode >= 100 && response.statusCode < 200);
+
+    const std::string connectionHeader = toLower(response.getHeader("connection"));
+    reusable = statusLine.compare(0, 8, "HTTP/1.0") == 0 ? connectionHeader == "keep-alive"
+                                                        : connectionHeader != "close";
+
+    if (onHeaders && !onHeaders(response))
+        return ABANDONED;
+    const OUTCOME outcome = readBody(connection, method, response, onBody, reusable);
+    if (outcome == FAILED)
+        response.error = t("http_body_incomplete");
+    return outcome;
+}
+
+bool HTTP_CLIENT::request(const std::string &method, const std::string &url,
+                          const std::map<std::string, std::string> &headers, const std::string &body,
+                          RESPONSE &response, HEADERS_CALLBACK onHeaders, BODY_CALLBACK onBody)
+{
+    std::string host, port, path;
+    if (!parseUrl(url, host, port, path))
+    {
+        response = RESPONSE();
+        response.error = t("http_unsupported_url") + ": " + url;
+        return false;
+    }
+
+    const std::string hostHeader = (host.find(':') != std::string::npos ? "[" + host + "]" : host) +
+                                   (port == "80" ? "" : ":" + port);
+    std::string request = method + " " + path + " HTTP/1.1\r\n"
+                                                "Host: " +
+                          hostHeader + "\r\n";
+    for (const auto &[name, value] : headers)
+        request += name + ": " + value + "\r\n";
+    if (!body.empty() || method == "POST" || method == "PUT")
+        request += "Content-Length: " + std::to_string(body.length()) + "\r\n";
+    request += "\r\n" + body;
+
+    const std::string key = host + ":" + port;
+    while (true)
+    {
+        response = RESPONSE();
+        CONNECTION connection;
+        if (!acquire(host, port, connection, response.error))
+            return false;
+        bool reusable = false;
+        const OUTCOME outcome = exchange(connection, method, request, response, onHeaders, onBody, reusable);
+        if (outcome == COMPLETE && reusable && connection.pending.empty())
+            release(key, connection);
+        else
+            closeSocket(connection.socket);
+        if (outcome == COMPLETE)
+            return true;
+        if (outcome == ABANDONED)
+        {
+            response.error = t("http_transfer_abandoned");
+            return false;
+        }
+        // A pooled connection the server has already dropped fails before a
+        // single response byte arrives; that is worth one more try.
+        if (!connection.reused || response.statusCode != 0)
+            return false;
+    }
+}
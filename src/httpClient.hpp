@@ -0,0 +1,112 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+// Minimal HTTP/1.1 client over plain Winsock or POSIX sockets. Connections
+// are kept alive and pooled per host:port, so consecutive requests to the
+// same server (checkVersion, the HEAD probe and every range request) reuse
+// one handshake. Bodies can be streamed to a callback instead of buffered.
+// Errors are reported through RESPONSE::error; nothing here terminates the
+// process, so the caller decides what is fatal.
+class HTTP_CLIENT
+{
+public:
+#ifdef _WIN32
+    typedef SOCKET SOCKET_HANDLE;
+#else
+    typedef int SOCKET_HANDLE;
+#endif
+
+    struct RESPONSE
+    {
+        int statusCode = 0;
+        std::map<std::string, std::string> headers;
+        std::string body;
+        std::string error;
+
+        std::string getHeader(const std::string &name) const;
+    };
+
+    // Called once the status line and headers are in; returning false
+    // abandons the body and the connection.
+    typedef std::function<bool(const RESPONSE &response)> HEADERS_CALLBACK;
+    // Called for each piece of the body; returning false aborts the transfer.
+    typedef std::function<bool(const char *data, size_t length)> BODY_CALLBACK;
+
+    explicit HTTP_CLIENT(int timeoutMs);
+    ~HTTP_CLIENT();
+    HTTP_CLIENT(const HTTP_CLIENT &) = delete;
+    HTTP_CLIENT &operator=(const HTTP_CLIENT &) = delete;
+
+    bool request(const std::string &method, const std::string &url,
+                 const std::map<std::string, std::string> &headers, const std::string &body,
+                 RESPONSE &response, HEADERS_CALLBACK onHeaders = nullptr, BODY_CALLBACK onBody = nullptr);
+
+    static bool parseUrl(const std::string &url, std::string &host, std::string &port, std::string &path);
+    // Resolves host now and keeps connecting to that address, so a later
+    // hosts-file redirect of the same name does not affect this client.
+    bool pinHost(const std::string &host, std::string &error);
+
+private:
+    static constexpr size_t MAX_IDLE_PER_HOST = 8;
+    static constexpr int IDLE_TIMEOUT_SECONDS = 30;
+    static constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+    struct CONNECTION
+    {
+        SOCKET_HANDLE socket;
+        std::string pending;
+        bool reused = false;
+        std::chrono::steady_clock::time_point idleSince;
+    };
+
+    enum OUTCOME
+    {
+        COMPLETE,
+        ABANDONED,
+        FAILED,
+    };
+
+    bool acquire(const std::string &host, const std::string &port, CONNECTION &connection, std::string &error);
+    void release(const std::string &key, CONNECTION &connection);
+    SOCKET_HANDLE connectTo(const std::string &host, const std::string &port, std::string &error);
+    static void closeSocket(SOCKET_HANDLE socket);
+
+    bool waitReadable(SOCKET_HANDLE socket);
+    bool sendAll(CONNECTION &connection, const std::string &data);
+    bool fill(CONNECTION &connection);
+    bool readLine(CONNECTION &connection, std::string &line);
+    OUTCOME readBody(CONNECTION &connection, const std::string &method, RESPONSE &response,
+                     BODY_CALLBACK &onBody, bool &reusable);
+    OUTCOME exchange(CONNECTION &connection, const std::string &method, const std::string &request,
+                     RESPONSE &response, HEADERS_CALLBACK &onHeaders, BODY_CALLBACK &onBody, bool &reusable);
+
+    const int timeoutMs;
+    std::mutex poolMutex;
+    std::multimap<std::string, CONNECTION> idleConnections;
+    std::map<std::string, std::string> pinnedHosts;
+};
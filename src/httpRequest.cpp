@@ -23,13 +23,13 @@
 
 HTTP_REQUEST::HTTP_REQUEST(std::string data)
 {
-    IO::Debug(t("parsing_http_request"));
+    IO_DEBUG(t("parsing_http_request"));
     std::istringstream ss(data);
     ss >> method >> path >> version;
-    IO::Debug(t("parsed_method_path_version") + ": " + method + " " + path + " " + version);
+    IO_DEBUG(t("parsed_method_path_version") + ": " + method + " " + path + " " + version);
     ss.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    IO::Debug(t("parsing_http_headers"));
+    IO_DEBUG(t("parsing_http_headers"));
     std::string header;
     while (std::getline(ss, header))
     {
@@ -43,11 +43,11 @@ HTTP_REQUEST::HTTP_REQUEST(std::string data)
             std::string key = header.substr(0, colonPos);
             std::string value = header.substr(colonPos + 1);
             headers[key] = value;
-            IO::Debug(t("parsed_header") + ": " + key + " = " + value);
+            IO_DEBUG(t("parsed_header") + ": " + key + " = " + value);
         }
     }
 
-    IO::Debug(t("parsing_request_body"));
+    IO_DEBUG(t("parsing_request_body"));
     std::string line;
     while (std::getline(ss, line))
     {
@@ -56,18 +56,18 @@ HTTP_REQUEST::HTTP_REQUEST(std::string data)
         body += line;
     }
 
-    IO::Debug(t("request_body_size") + ": " + std::to_string(body.length()) + " " + t("bytes"));
-    IO::Debug(t("http_request_parsed"));
+    IO_DEBUG(t("request_body_size") + ": " + std::to_string(body.length()) + " " + t("bytes"));
+    IO_DEBUG(t("http_request_parsed"));
 }
 
 std::pair<size_t, size_t> HTTP_REQUEST::parseRangeHeader(std::string rangeHeader, size_t fileSize)
 {
-    IO::Debug(t("parsing_range_header") + ": " + rangeHeader);
+    IO_DEBUG(t("parsing_range_header") + ": " + rangeHeader);
 
     size_t bytesPos = rangeHeader.find("bytes=");
     if (bytesPos == std::string::npos)
     {
-        IO::Debug(t("range_header_parsed") + ": " + t("serving_full_file"));
+        IO_DEBUG(t("range_header_parsed") + ": " + t("serving_full_file"));
         return {0, fileSize - 1};
     }
 
@@ -76,7 +76,7 @@ std::pair<size_t, size_t> HTTP_REQUEST::parseRangeHeader(std::string rangeHeader
 
     if (dashPos == std::string::npos)
     {
-        IO::Debug(t("range_header_parsed") + ": " + t("serving_full_file") + " (no dash)");
+        IO_DEBUG(t("range_header_parsed") + ": " + t("serving_full_file") + " (no dash)");
         return {0, fileSize - 1};
     }
 
@@ -101,8 +101,8 @@ std::pair<size_t, size_t> HTTP_REQUEST::parseRangeHeader(std::string rangeHeader
     if (start > end)
         start = end;
 
-    IO::Debug(t("range_header_parsed") + ": " + std::to_string(start) + "-" + std::to_string(end) +
-              " (" + t("length") + ": " + std::to_string(end - start + 1) + ")");
+    IO_DEBUG(t("range_header_parsed") + ": " + std::to_string(start) + "-" + std::to_string(end) +
+             " (" + t("length") + ": " + std::to_string(end - start + 1) + ")");
 
     return {start, end};
 }
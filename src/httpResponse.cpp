@@ -21,15 +21,15 @@
 
 void HTTP_RESPONSE::setBody(std::string bodyContent)
 {
-    IO::Debug(t("setting_response_body") + " (" + std::to_string(bodyContent.length()) + " " + t("bytes") + ")");
+    IO_DEBUG(t("setting_response_body") + " (" + std::to_string(bodyContent.length()) + " " + t("bytes") + ")");
     body = bodyContent;
     headers["Content-Length"] = std::to_string(body.length());
-    IO::Debug(t("content_length_set") + ": " + std::to_string(body.length()));
+    IO_DEBUG(t("content_length_set") + ": " + std::to_string(body.length()));
 }
 std::string HTTP_RESPONSE::headerToString()
 {
-    IO::Debug(t("generating_response_header"));
-    IO::Debug(t("response_status_code") + ": " + std::to_string(statusCode));
+    IO_DEBUG(t("generating_response_header"));
+    IO_DEBUG(t("response_status_code") + ": " + std::to_string(statusCode));
 
     std::string header = "HTTP/1.1 " +
                          std::to_string(statusCode) + " " +
@@ -38,16 +38,16 @@ std::string HTTP_RESPONSE::headerToString()
     for (auto [key, value] : headers)
     {
         header += key + ": " + value + "\r\n";
-        IO::Debug(t("adding_response_header") + ": " + key + " = " + value);
+        IO_DEBUG(t("adding_response_header") + ": " + key + " = " + value);
     }
 
-    IO::Debug(t("response_header_generated") + " (" + std::to_string(header.length()) + " " + t("bytes") + ")");
+    IO_DEBUG(t("response_header_generated") + " (" + std::to_string(header.length()) + " " + t("bytes") + ")");
     return header;
 }
 std::string HTTP_RESPONSE::toString()
 {
-    IO::Debug(t("generating_full_response"));
+    IO_DEBUG(t("generating_full_response"));
     std::string fullResponse = headerToString() + "\r\n" + body;
-    IO::Debug(t("response_size") + ": " + std::to_string(fullResponse.length()) + " " + t("bytes"));
+    IO_DEBUG(t("response_size") + ": " + std::to_string(fullResponse.length()) + " " + t("bytes"));
     return fullResponse;
 }
@@ -26,7 +26,9 @@ private:
     const std::map<int, std::string> statusCodes = {
         {200, "OK"},
         {206, "Partial Content"},
-        {404, "Not Found"}};
+        {403, "Forbidden"},
+        {404, "Not Found"},
+        {503, "Service Unavailable"}};
 
 public:
     int statusCode;
@@ -20,6 +20,8 @@
 #include "io.hpp"
 #include "define.hpp"
 #include "i18n.hpp"
+#include "trace.hpp"
+#include "mappedFile.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -28,32 +30,68 @@
 #include <filesystem>
 #include <thread>
 #include <map>
+#include <memory>
+#include <chrono>
 #include <ws2tcpip.h>
+#include <mswsock.h>
 
 const int HTTP_SERVER::BUFFER_SIZE;
 
-HTTP_SERVER::HTTP_SERVER(int port, std::string imagePath, std::string otaData, std::string otaUrl)
-    : serverPort(port), imagePath(imagePath), otaData(otaData), otaUrl(otaUrl), isRunning(false), serverSocket(INVALID_SOCKET)
+HTTP_SERVER::HTTP_SERVER(int port)
+    : serverPort(port), isRunning(false), serverSocket(INVALID_SOCKET)
 {
 }
 
+void HTTP_SERVER::addRoute(std::string otaUrl, std::string imagePath, IMAGE &image)
+{
+    std::lock_guard<std::mutex> lock(routesMutex);
+    routes.push_back({otaUrl, imagePath, &image});
+    routeAdded.notify_all();
+}
+
+IMAGE *HTTP_SERVER::findImage(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(routesMutex);
+    for (const ROUTE &route : routes)
+        if (path == route.imagePath || path.substr(0, route.imagePath.length() + 1) == route.imagePath + "?")
+            return route.image;
+    return nullptr;
+}
+
+IMAGE *HTTP_SERVER::findOtaRoute(const std::string &path, const std::string &endpoint)
+{
+    if (path.length() < endpoint.length() || path.compare(path.length() - endpoint.length(), endpoint.length(), endpoint) != 0)
+        return nullptr;
+    IMAGE *image = nullptr;
+    auto find = [&]()
+    {
+        for (const ROUTE &route : routes)
+            if (path == route.otaUrl + endpoint)
+                image = route.image;
+        return image != nullptr;
+    };
+    std::unique_lock<std::mutex> lock(routesMutex);
+    routeAdded.wait_for(lock, std::chrono::seconds(ROUTE_WAIT_SECONDS), find);
+    return image;
+}
+
 void HTTP_SERVER::start()
 {
-    IO::Debug(t("initializing_winsock"));
+    IO_DEBUG(t("initializing_winsock"));
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
         DIE("WSAStartup failed");
 
-    IO::Debug(t("creating_server_socket"));
+    IO_DEBUG(t("creating_server_socket"));
     serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket == INVALID_SOCKET)
         DIE("Failed to create socket");
 
-    IO::Debug(t("setting_socket_options"));
+    IO_DEBUG(t("setting_socket_options"));
     int opt = 1;
     setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt));
 
-    IO::Debug(t("binding_to_port") + " " + std::to_string(serverPort) + "...");
+    IO_DEBUG(t("binding_to_port") + " " + std::to_string(serverPort) + "...");
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
@@ -61,13 +99,13 @@ void HTTP_SERVER::start()
 
     if (bind(serverSocket, (sockaddr *)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR)
         DIE("Failed to bind socket");
-    IO::Debug(t("starting_listen"));
+    IO_DEBUG(t("starting_listen"));
     if (listen(serverSocket, 16) == SOCKET_ERROR)
         DIE("Failed to listen on socket");
 
     isRunning = true;
     IO::Info(t("server_started_press_x"));
-    IO::Debug(t("server_listening") + " " + std::to_string(serverPort));
+    IO_DEBUG(t("server_listening") + " " + std::to_string(serverPort));
 
     serverThread = std::thread(
         [this]()
@@ -84,25 +122,28 @@ void HTTP_SERVER::start()
                     continue;
                 }
 
-                IO::Debug(t("new_client_connected"));
+                IO_DEBUG(t("new_client_connected"));
+                metrics.acceptedConnections.add();
+                const bool fromStation = clientAddr.sin_addr.s_addr == htonl(INADDR_LOOPBACK);
                 std::thread(
-                    [this, clientSocket]()
+                    [this, clientSocket, fromStation]()
                     {
+                        METRICS::HOLD connection(metrics.activeConnections);
                         char buffer[BUFFER_SIZE];
                         int bytesReceived = recv(clientSocket, buffer, BUFFER_SIZE - 1, 0);
                         if (bytesReceived > 0)
                         {
                             buffer[bytesReceived] = '\0';
                             std::string request(buffer);
-                            IO::Debug(t("received_request_bytes") + " " + std::to_string(bytesReceived) + " " + t("bytes"));
-                            handleRequest(clientSocket, request);
+                            IO_DEBUG(t("received_request_bytes") + " " + std::to_string(bytesReceived) + " " + t("bytes"));
+                            handleRequest(clientSocket, request, fromStation);
                         }
                         else
                         {
-                            IO::Debug(t("no_data_received"));
+                            IO_DEBUG(t("no_data_received"));
                         }
                         closesocket(clientSocket);
-                        IO::Debug(t("client_connection_closed"));
+                        IO_DEBUG(t("client_connection_closed"));
                     })
                     .detach();
             }
@@ -126,27 +167,52 @@ void HTTP_SERVER::stop()
     WSACleanup();
 }
 
-void HTTP_SERVER::handleRequest(int clientSocket, HTTP_REQUEST request)
+void HTTP_SERVER::handleRequest(int clientSocket, HTTP_REQUEST request, bool fromStation)
 {
-    IO::Debug(t("processing_http_request") + ": " + request.path);
-    IO::Debug(t("http_method") + ": " + request.method);
-    if (request.path.length() >= 10 && request.path.substr(0, 10) == "/image.img")
+    TRACE::SCOPE scope("request", "http");
+    const auto started = std::chrono::steady_clock::now();
+    IO_DEBUG(t("processing_http_request") + ": " + request.path);
+    IO_DEBUG(t("http_method") + ": " + request.method);
+    METRICS::ENDPOINT endpoint = METRICS::UNKNOWN_ENDPOINT;
+    IMAGE *image = nullptr;
+    if (request.path == "/metrics")
     {
+        // Pens share the hotspot with this port; only the station may look.
+        endpoint = METRICS::METRICS_ENDPOINT;
+        if (fromStation)
+            sendHttpResponse(clientSocket, 200, "text/plain; version=0.0.4", metrics.render());
+        else
+            sendHttpResponse(clientSocket, 403, "text/plain", "Forbidden");
+    }
+    else if ((image = findImage(request.path)) != nullptr)
+    {
+        endpoint = METRICS::IMAGE_ENDPOINT;
         IO::Info(t("serving_image_file"));
-        sendFileResponse(clientSocket, request.headers);
+        sendFileResponse(clientSocket, request.headers, *image);
     }
     else if (request.path.length() > 10 && request.path.substr(0, 10) == "/register/")
     {
+        endpoint = METRICS::REGISTER_ENDPOINT;
         IO::Info(t("serving_register_data"));
         sendHttpResponse(clientSocket, 200, "application/json;charset=UTF-8", R"({"status":1000,"msg":"success","data":{"deviceSecret":"de8b9bcd0a18afbf25b44f6d4f6c5f23","sha256":"8a6860050ac879171800a8315fc516b46d6baf81f73910ab1ab5d7e9059d427f","deviceId":"f730c7fa72bd3871"}})");
     }
-    else if (request.path == otaUrl + "/checkVersion" && request.method == "POST")
+    else if (request.method == "POST" && (image = findOtaRoute(request.path, "/checkVersion")) != nullptr)
     {
-        IO::Info(t("serving_ota_data"));
-        sendHttpResponse(clientSocket, 200, "application/json;charset=UTF-8", otaData);
+        endpoint = METRICS::CHECK_VERSION_ENDPOINT;
+        // In streaming mode the answer exists only once the image is final.
+        std::string otaData;
+        if (image->waitForOtaData(otaData, std::chrono::seconds(IMAGE_WAIT_SECONDS)))
+        {
+            IO::Info(t("serving_ota_data"));
+            sendHttpResponse(clientSocket, 200, "application/json;charset=UTF-8", otaData);
+        }
+        else
+            sendImageUnavailable(clientSocket, *image);
     }
-    else if (request.path == otaUrl + "/reportDownResult" && request.method == "POST")
+    else if (request.method == "POST" && (image = findOtaRoute(request.path, "/reportDownResult")) != nullptr)
     {
+        endpoint = METRICS::REPORT_ENDPOINT;
+        image->report();
         IO::Info(t("serving_ota_report"));
         sendHttpResponse(clientSocket, 200, "application/json;charset=UTF-8", R"({"status":1000,"msg":"success","data":null})");
     }
@@ -155,6 +221,8 @@ void HTTP_SERVER::handleRequest(int clientSocket, HTTP_REQUEST request)
         IO::Info(t("request_not_found_404"));
         sendHttpResponse(clientSocket, 404, "text/plain", "File Not Found");
     }
+    metrics.requests[endpoint].add();
+    metrics.latency[endpoint].observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
 }
 
 void HTTP_SERVER::sendHttpResponse(int clientSocket, int statusCode, std::string contentType,
@@ -167,16 +235,43 @@ void HTTP_SERVER::sendHttpResponse(int clientSocket, int statusCode, std::string
     std::string responseString = response.toString();
     if (send(clientSocket, responseString.c_str(), responseString.length(), 0) == SOCKET_ERROR)
         IO::Warn(t("failed_send_response"));
-    IO::Debug(t("sent_http_response") + ": " + std::to_string(response.statusCode));
+    else
+        metrics.bytesServed.add(responseString.length());
+    IO_DEBUG(t("sent_http_response") + ": " + std::to_string(response.statusCode));
 }
-void HTTP_SERVER::sendFileResponse(int clientSocket, std::map<std::string, std::string> headers)
+void HTTP_SERVER::sendImageUnavailable(int clientSocket, IMAGE &image)
 {
-    IO::Debug(t("preparing_file_response") + ": " + imagePath);
-    size_t fileSize = std::filesystem::file_size(imagePath);
-    IO::Debug(t("file_size") + ": " + std::to_string(fileSize) + " " + t("bytes"));
-    std::ifstream file(imagePath, std::ios::binary);
-    if (!file.is_open())
-        DIE("Failed to open file: " + imagePath);
+    if (image.hasFailed())
+    {
+        IO::Warn(t("image_failed_404"));
+        sendHttpResponse(clientSocket, 404, "text/plain", "File Not Found");
+    }
+    else
+    {
+        IO::Warn(t("image_not_ready_503"));
+        sendHttpResponse(clientSocket, 503, "text/plain", "Service Unavailable");
+    }
+}
+
+void HTTP_SERVER::sendFileResponse(int clientSocket, std::map<std::string, std::string> headers, IMAGE &image)
+{
+    TRACE::SCOPE scope("send image", "http");
+    METRICS::HOLD transfer(metrics.imageTransfers);
+    size_t fileSize;
+    if (!image.waitForSize(fileSize, std::chrono::seconds(IMAGE_WAIT_SECONDS)))
+    {
+        sendImageUnavailable(clientSocket, image);
+        return;
+    }
+    const std::string path = image.getPath();
+    const std::vector<HASH::PATCH> patches = image.getPatches();
+    IO_DEBUG(t("preparing_file_response") + ": " + path);
+    IO_DEBUG(t("file_size") + ": " + std::to_string(fileSize) + " " + t("bytes"));
+    // Shared for writing: in streaming mode the download is still filling it.
+    HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        DIE("Failed to open file: " + path);
 
     HTTP_RESPONSE responseHeader;
 
@@ -188,19 +283,19 @@ void HTTP_SERVER::sendFileResponse(int clientSocket, std::map<std::string, std::
     std::string rangeString = headers["Range"];
     if (rangeString != "")
     {
-        IO::Debug(t("processing_range_request") + ": " + rangeString);
+        IO_DEBUG(t("processing_range_request") + ": " + rangeString);
         auto range = HTTP_REQUEST::parseRangeHeader(rangeString, fileSize);
         startPos = range.first;
         endPos = range.second;
         contentLength = endPos - startPos + 1;
-        IO::Debug(t("range") + ": " + std::to_string(startPos) + "-" + std::to_string(endPos) + " (" + t("length") + ": " + std::to_string(contentLength) + ")");
+        IO_DEBUG(t("range") + ": " + std::to_string(startPos) + "-" + std::to_string(endPos) + " (" + t("length") + ": " + std::to_string(contentLength) + ")");
 
         responseHeader.statusCode = 206;
         responseHeader.headers["Content-Range"] = "bytes " + std::to_string(startPos) + "-" + std::to_string(endPos) + "/" + std::to_string(fileSize);
     }
     else
     {
-        IO::Debug(t("serving_full_file"));
+        IO_DEBUG(t("serving_full_file"));
     }
 
     responseHeader.headers["Content-Type"] = "application/octet-stream";
@@ -208,30 +303,101 @@ void HTTP_SERVER::sendFileResponse(int clientSocket, std::map<std::string, std::
     responseHeader.headers["Content-Length"] = std::to_string(contentLength);
 
     std::string responseHeaderString = responseHeader.headerToString() + "\r\n";
-    IO::Debug(t("sending_http_headers") + " (" + std::to_string(responseHeaderString.length()) + " " + t("bytes") + ")");
+    IO_DEBUG(t("sending_http_headers") + " (" + std::to_string(responseHeaderString.length()) + " " + t("bytes") + ")");
     if (send(clientSocket, responseHeaderString.c_str(), responseHeaderString.length(), 0) == SOCKET_ERROR)
         IO::Warn(t("failed_send_headers"));
+    else
+        metrics.bytesServed.add(responseHeaderString.length());
 
-    file.seekg(startPos);
-
-    char buffer[BUFFER_SIZE];
-    size_t remainingBytes = contentLength;
-    size_t totalSent = 0;
-    IO::Debug(t("starting_file_transfer"));
+    const size_t end = startPos + contentLength;
+    size_t position = startPos;
+    IO_DEBUG(t("starting_file_transfer"));
+    const bool transmit = metrics.imageTransfers.get() <= MAX_TRANSMIT_FILE_TRANSFERS;
+    std::unique_ptr<MAPPED_FILE> mapped;
 
-    while (remainingBytes > 0 && (file.read(buffer, std::min((size_t)BUFFER_SIZE, remainingBytes)) || file.gcount() > 0))
+    while (position < end)
     {
-        size_t bytesToSend = file.gcount();
-        if (send(clientSocket, buffer, bytesToSend, 0) == SOCKET_ERROR)
+        // Patched bytes come from memory; everything else goes from the
+        // file cache to the socket without passing through this process.
+        const HASH::PATCH *patch = nullptr;
+        size_t pieceEnd = end;
+        for (const HASH::PATCH &candidate : patches)
+        {
+            const size_t patchEnd = candidate.offset + candidate.bytes.size();
+            if (candidate.offset <= position && position < patchEnd)
+            {
+                patch = &candidate;
+                pieceEnd = std::min(end, patchEnd);
+                break;
+            }
+            if (candidate.offset > position)
+                pieceEnd = std::min(pieceEnd, candidate.offset);
+        }
+
+        bool sent;
+        if (patch)
+            sent = sendAll(clientSocket, patch->bytes.data() + (position - patch->offset), pieceEnd - position);
+        else
+        {
+            // Bytes still being downloaded are sent as soon as they are final;
+            // the headers are out, so a stalled image just ends the transfer.
+            size_t available;
+            if (!image.waitAvailable(position + 1, available, std::chrono::seconds(IMAGE_WAIT_SECONDS)))
+            {
+                IO::Warn(t("image_stalled") + ": " + std::to_string(position) + "/" + std::to_string(fileSize));
+                CloseHandle(file);
+                return;
+            }
+            pieceEnd = std::min(pieceEnd, available);
+            if (transmit)
+                sent = transmitFile(clientSocket, file, position, pieceEnd - position);
+            else
+            {
+                if (!mapped)
+                    mapped.reset(new MAPPED_FILE(path, MAPPED_FILE::READ_SHARED));
+                sent = sendAll(clientSocket, reinterpret_cast<const char *>(mapped->data()) + position, pieceEnd - position);
+            }
+        }
+        if (!sent)
         {
             IO::Warn(t("failed_send_file_data") + ": " + std::to_string(WSAGetLastError()));
+            CloseHandle(file);
             return;
         }
-        remainingBytes -= bytesToSend;
-        totalSent += bytesToSend;
+        metrics.bytesServed.add(pieceEnd - position);
+        position = pieceEnd;
     }
-    file.close();
+    CloseHandle(file);
 
     IO::Info(t("sent_image_file") + " (" + std::to_string(startPos) + "~" + std::to_string(endPos) + ")");
-    IO::Debug(t("file_transfer_completed") + ": " + std::to_string(totalSent) + " " + t("bytes"));
+    IO_DEBUG(t("file_transfer_completed") + ": " + std::to_string(position - startPos) + " " + t("bytes"));
+}
+
+bool HTTP_SERVER::sendAll(int clientSocket, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        const int sent = send(clientSocket, data, (int)std::min(length, (size_t)BUFFER_SIZE), 0);
+        if (sent == SOCKET_ERROR)
+            return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+bool HTTP_SERVER::transmitFile(int clientSocket, HANDLE file, size_t offset, size_t length)
+{
+    while (length > 0)
+    {
+        const DWORD chunk = (DWORD)std::min(length, TRANSMIT_CHUNK_SIZE);
+        LARGE_INTEGER position;
+        position.QuadPart = offset;
+        if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) ||
+            !TransmitFile(clientSocket, file, chunk, 0, NULL, NULL, 0))
+            return false;
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
 }
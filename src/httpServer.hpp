@@ -21,29 +21,60 @@
 #include <string>
 #include <functional>
 #include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 #include "httpRequest.hpp"
 #include "httpResponse.hpp"
+#include "image.hpp"
+#include "metrics.hpp"
 
+// Each route pairs a pen's OTA URL with the image served to it, so one
+// server can answer several pens with their own checkVersion data.
 class HTTP_SERVER
 {
 public:
-    HTTP_SERVER(int port, std::string imagePath, std::string otaData, std::string otaUrl);
+    explicit HTTP_SERVER(int port);
+    // The image must outlive the server. Routes may be added while running.
+    void addRoute(std::string otaUrl, std::string imagePath, IMAGE &image);
     void start();
     void stop();
 
 private:
-    void handleRequest(int clientSocket, HTTP_REQUEST request);
+    struct ROUTE
+    {
+        std::string otaUrl;
+        std::string imagePath;
+        IMAGE *image;
+    };
+    // A pen may ask before its capture has been turned into a route.
+    static constexpr int ROUTE_WAIT_SECONDS = 5;
+    // Longer than a pen waits for one answer; it polls again after a 503.
+    static constexpr int IMAGE_WAIT_SECONDS = 120;
+
+    IMAGE *findImage(const std::string &path);
+    IMAGE *findOtaRoute(const std::string &path, const std::string &endpoint);
+    void handleRequest(int clientSocket, HTTP_REQUEST request, bool fromStation);
 
     void sendHttpResponse(int clientSocket, int statusCode, std::string contentType,
                           std::string body, std::string extraHeaders = "");
-    void sendFileResponse(int clientSocket, std::map<std::string, std::string> headers);
+    void sendImageUnavailable(int clientSocket, IMAGE &image);
+    void sendFileResponse(int clientSocket, std::map<std::string, std::string> headers, IMAGE &image);
+    bool sendAll(int clientSocket, const char *data, size_t length);
+    bool transmitFile(int clientSocket, HANDLE file, size_t offset, size_t length);
 
     int serverPort;
-    std::string imagePath;
-    std::string otaData;
-    std::string otaUrl;
+    std::vector<ROUTE> routes;
+    std::mutex routesMutex;
+    std::condition_variable routeAdded;
+    METRICS metrics;
     std::thread serverThread;
     bool isRunning;
     SOCKET serverSocket;
     static const int BUFFER_SIZE = 8192;
+    // TransmitFile takes at most 2 GiB - 2 bytes per call.
+    static constexpr size_t TRANSMIT_CHUNK_SIZE = 1 << 30;
+    // Client editions of Windows run at most two TransmitFile calls at once
+    // and queue the rest; transfers beyond that send from a mapped view.
+    static constexpr int64_t MAX_TRANSMIT_FILE_TRANSFERS = 2;
 };
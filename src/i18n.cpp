@@ -17,6 +17,7 @@
 
 #include "i18n.hpp"
 #include "io.hpp"
+#include "argc.hpp"
 #include <windows.h>
 
 namespace I18N
@@ -48,8 +49,6 @@ namespace I18N
         {"searching_hash_patterns", {{Language::ENGLISH, "Searching for hash patterns in file"}, {Language::CHINESE, "正在文件中搜索哈希模式"}}},
         {"file_size", {{Language::ENGLISH, "File size"}, {Language::CHINESE, "文件大小"}}},
         {"bytes", {{Language::ENGLISH, "bytes"}, {Language::CHINESE, "字节"}}},
-        {"using_buffer_size", {{Language::ENGLISH, "Using buffer size"}, {Language::CHINESE, "当前缓冲区大小"}}},
-        {"with_overlap", {{Language::ENGLISH, "with overlap"}, {Language::CHINESE, "及重叠部分"}}},
 
         // HTTP Server
         {"stopping_http_server", {{Language::ENGLISH, "Stopping HTTP server..."}, {Language::CHINESE, "正在停止 HTTP 服务器..."}}},
@@ -72,6 +71,9 @@ namespace I18N
         {"serving_ota_data", {{Language::ENGLISH, "Serving OTA update data"}, {Language::CHINESE, "正在提供 OTA 更新数据"}}},
         {"serving_ota_report", {{Language::ENGLISH, "Serving OTA report"}, {Language::CHINESE, "正在提供 OTA 报告"}}},
         {"request_not_found_404", {{Language::ENGLISH, "Request not found, sending 404"}, {Language::CHINESE, "请求的资源不存在，返回 404"}}},
+        {"image_failed_404", {{Language::ENGLISH, "Image will never be ready, sending 404"}, {Language::CHINESE, "镜像无法就绪，返回 404"}}},
+        {"image_not_ready_503", {{Language::ENGLISH, "Image not ready yet, sending 503"}, {Language::CHINESE, "镜像尚未就绪，返回 503"}}},
+        {"image_stalled", {{Language::ENGLISH, "Image stopped growing during transfer"}, {Language::CHINESE, "传输过程中镜像停止增长"}}},
         {"failed_send_response", {{Language::ENGLISH, "Failed to send HTTP response"}, {Language::CHINESE, "发送 HTTP 响应失败"}}},
         {"sent_http_response", {{Language::ENGLISH, "Sent HTTP response"}, {Language::CHINESE, "HTTP 响应发送成功"}}},
 
@@ -111,12 +113,9 @@ namespace I18N
         // Packet capture messages
         {"packet_received", {{Language::ENGLISH, "Packet received, length"}, {Language::CHINESE, "收到数据包，长度"}}},
         {"target_packet_found", {{Language::ENGLISH, "Target packet found, breaking capture loop"}, {Language::CHINESE, "已找到目标数据包，正在中断抓包"}}},
-        {"packet_too_small_network", {{Language::ENGLISH, "Packet too small for network layer analysis"}, {Language::CHINESE, "数据包过小，无法进行网络层分析"}}},
-        {"non_ipv4_packet", {{Language::ENGLISH, "Non-IPv4 packet detected"}, {Language::CHINESE, "检测到非 IPv4 数据包"}}},
-        {"non_ipv4_packet_header", {{Language::ENGLISH, "Non-IPv4 packet in IP header"}, {Language::CHINESE, "IP 标头中包含非 IPv4 数据包"}}},
+        {"packet_truncated", {{Language::ENGLISH, "Packet too small for header analysis"}, {Language::CHINESE, "数据包过小，无法进行标头分析"}}},
+        {"non_ip_packet", {{Language::ENGLISH, "Non-IP packet detected"}, {Language::CHINESE, "检测到非 IP 数据包"}}},
         {"non_tcp_packet", {{Language::ENGLISH, "Non-TCP packet detected"}, {Language::CHINESE, "检测到非 TCP 数据包"}}},
-        {"network_layer_passed", {{Language::ENGLISH, "Network layer analysis passed"}, {Language::CHINESE, "网络层分析通过"}}},
-        {"packet_too_small_transport", {{Language::ENGLISH, "Packet too small for transport layer analysis"}, {Language::CHINESE, "数据包过小，无法进行传输层分析"}}},
         {"invalid_tcp_header", {{Language::ENGLISH, "Invalid TCP header offset"}, {Language::CHINESE, "无效的 TCP 标头偏移量"}}},
         {"non_http_port", {{Language::ENGLISH, "Non-HTTP port detected: src"}, {Language::CHINESE, "检测到非 HTTP 端口：源"}}},
         {"dst", {{Language::ENGLISH, "dst"}, {Language::CHINESE, "目标"}}},
@@ -132,14 +131,19 @@ namespace I18N
         {"initializing_capture", {{Language::ENGLISH, "Initializing packet capture system"}, {Language::CHINESE, "正在初始化抓包系统"}}},
         {"finding_devices", {{Language::ENGLISH, "Finding network devices..."}, {Language::CHINESE, "正在查找网络设备..."}}},
         {"error_finding_devices", {{Language::ENGLISH, "Error while finding network devices"}, {Language::CHINESE, "查找网络设备时出错"}}},
-        {"searching_hotspot", {{Language::ENGLISH, "Searching for hotspot interface (192.168.137.1)..."}, {Language::CHINESE, "正在搜索热点接口 (192.168.137.1)..."}}},
+        {"searching_hotspot", {{Language::ENGLISH, "Searching for hotspot interfaces..."}, {Language::CHINESE, "正在搜索热点接口..."}}},
+        {"invalid_ipv4_argument", {{Language::ENGLISH, "Invalid IPv4 address argument"}, {Language::CHINESE, "IPv4 地址参数无效"}}},
+        {"capture_argument_not_positive", {{Language::ENGLISH, "Capture argument must be positive"}, {Language::CHINESE, "抓包参数必须为正数"}}},
+        {"capture_argument_clamped", {{Language::ENGLISH, "Capture argument too large, using"}, {Language::CHINESE, "抓包参数过大，改用"}}},
+        {"capturing_on_interfaces", {{Language::ENGLISH, "Capturing on matching interfaces"}, {Language::CHINESE, "正在以下数量的匹配接口上抓包"}}},
         {"checking_device", {{Language::ENGLISH, "Checking device"}, {Language::CHINESE, "正在检查设备"}}},
         {"found_target_interface", {{Language::ENGLISH, "Found target interface"}, {Language::CHINESE, "已找到目标接口"}}},
         {"no_interface_found", {{Language::ENGLISH, "No available interface found, make sure you have opened the mobile hotspot."}, {Language::CHINESE, "未找到可用接口，请确保已开启移动热点。"}}},
         {"opening_capture_handle", {{Language::ENGLISH, "Opening capture handle for device"}, {Language::CHINESE, "正在为设备打开抓包句柄"}}},
         {"unable_open_adapter", {{Language::ENGLISH, "Unable to open the adapter"}, {Language::CHINESE, "无法打开网络适配器"}}},
         {"checking_datalink", {{Language::ENGLISH, "Checking data link type..."}, {Language::CHINESE, "正在检查数据链路类型..."}}},
-        {"non_ethernet_link", {{Language::ENGLISH, "Non-Ethernet link layer detected. Packet parsing might be off."}, {Language::CHINESE, "检测到非以太网链路层，数据包解析可能有误。"}}},
+        {"unsupported_datalink", {{Language::ENGLISH, "Unsupported data link type"}, {Language::CHINESE, "不支持的数据链路类型"}}},
+        {"datalink_parser_selected", {{Language::ENGLISH, "Selected packet parser for data link"}, {Language::CHINESE, "已为数据链路选择数据包解析器"}}},
         {"setting_packet_filter", {{Language::ENGLISH, "Setting up packet filter..."}, {Language::CHINESE, "正在设置数据包过滤器..."}}},
         {"compiling_filter", {{Language::ENGLISH, "Compiling filter"}, {Language::CHINESE, "正在编译过滤器"}}},
         {"unable_compile_filter", {{Language::ENGLISH, "Unable to compile the packet filter"}, {Language::CHINESE, "无法编译数据包过滤器"}}},
@@ -148,9 +152,42 @@ namespace I18N
         {"waiting_update_packets", {{Language::ENGLISH, "Waiting for update packets... Please check updates on your dictpen"}, {Language::CHINESE, "正在等待更新数据包...请在词典笔上检查更新"}}},
         {"starting_capture_loop", {{Language::ENGLISH, "Starting packet capture loop..."}, {Language::CHINESE, "正在启动抓包循环..."}}},
         {"captured_update_request", {{Language::ENGLISH, "Captured update request for product"}, {Language::CHINESE, "已抓取到产品更新请求"}}},
+        {"capture_buffer_size", {{Language::ENGLISH, "Capture buffer size"}, {Language::CHINESE, "抓包缓冲区大小"}}},
+        {"capture_read_timeout", {{Language::ENGLISH, "Capture read timeout"}, {Language::CHINESE, "抓包读取超时"}}},
+        {"capture_immediate_mode", {{Language::ENGLISH, "Enabling immediate capture mode"}, {Language::CHINESE, "正在启用即时抓包模式"}}},
+        {"capture_activate_warning", {{Language::ENGLISH, "Capture handle activated with warning"}, {Language::CHINESE, "抓包句柄已激活，但有警告"}}},
+        {"capture_latency", {{Language::ENGLISH, "Capture-to-match latency"}, {Language::CHINESE, "抓包到匹配的延迟"}}},
+        {"packet_ring_capacity", {{Language::ENGLISH, "Packet handoff ring capacity"}, {Language::CHINESE, "数据包交接环形队列容量"}}},
+        {"packet_ring_high_water", {{Language::ENGLISH, "Packet handoff ring peak occupancy"}, {Language::CHINESE, "数据包交接环形队列峰值占用"}}},
+        {"packet_ring_overflows", {{Language::ENGLISH, "Packets dropped because the handoff ring was full"}, {Language::CHINESE, "因交接环形队列已满而丢弃的数据包"}}},
+        {"packet_ring_truncated", {{Language::ENGLISH, "Packets longer than a ring slot, rejected"}, {Language::CHINESE, "超过队列槽大小而被拒绝的数据包"}}},
+        {"press_s_for_statistics", {{Language::ENGLISH, "Press [s] to show capture statistics"}, {Language::CHINESE, "按 [s] 键查看抓包统计"}}},
+        {"capture_statistics", {{Language::ENGLISH, "Capture statistics"}, {Language::CHINESE, "抓包统计"}}},
+        {"stats_received", {{Language::ENGLISH, "received"}, {Language::CHINESE, "已接收"}}},
+        {"stats_processed", {{Language::ENGLISH, "processed"}, {Language::CHINESE, "已处理"}}},
+        {"stats_matched", {{Language::ENGLISH, "matched"}, {Language::CHINESE, "已匹配"}}},
+        {"stats_dropped", {{Language::ENGLISH, "dropped"}, {Language::CHINESE, "已丢弃"}}},
+        {"stats_if_dropped", {{Language::ENGLISH, "interface dropped"}, {Language::CHINESE, "接口丢弃"}}},
+        {"stats_kernel", {{Language::ENGLISH, "Kernel"}, {Language::CHINESE, "内核"}}},
+        {"stats_ring", {{Language::ENGLISH, "Handoff ring occupancy"}, {Language::CHINESE, "交接队列占用"}}},
+        {"stats_rejected_truncated", {{Language::ENGLISH, "Rejected (truncated frame)"}, {Language::CHINESE, "已拒绝（帧不完整）"}}},
+        {"stats_rejected_non_ip", {{Language::ENGLISH, "Rejected (non-IP)"}, {Language::CHINESE, "已拒绝（非 IP）"}}},
+        {"stats_rejected_non_tcp", {{Language::ENGLISH, "Rejected (non-TCP)"}, {Language::CHINESE, "已拒绝（非 TCP）"}}},
+        {"stats_rejected_invalid_tcp", {{Language::ENGLISH, "Rejected (invalid TCP header)"}, {Language::CHINESE, "已拒绝（TCP 标头无效）"}}},
+        {"stats_rejected_wrong_port", {{Language::ENGLISH, "Rejected (wrong port)"}, {Language::CHINESE, "已拒绝（端口不符）"}}},
+        {"stats_rejected_empty_payload", {{Language::ENGLISH, "Rejected (empty payload)"}, {Language::CHINESE, "已拒绝（有效负载为空）"}}},
+        {"stats_rejected_no_match", {{Language::ENGLISH, "Rejected (no match)"}, {Language::CHINESE, "已拒绝（不匹配）"}}},
+        {"stats_latency_histogram", {{Language::ENGLISH, "Capture-to-match latency"}, {Language::CHINESE, "抓包到匹配延迟分布"}}},
+        {"replaying_capture_file", {{Language::ENGLISH, "Replaying capture file"}, {Language::CHINESE, "正在回放抓包文件"}}},
+        {"unable_open_capture_file", {{Language::ENGLISH, "Unable to open the capture file"}, {Language::CHINESE, "无法打开抓包文件"}}},
+        {"replay_throughput", {{Language::ENGLISH, "Replay throughput"}, {Language::CHINESE, "回放吞吐量"}}},
+        {"packets_in", {{Language::ENGLISH, "packets in"}, {Language::CHINESE, "个数据包，耗时"}}},
+        {"packets_per_second", {{Language::ENGLISH, "packets/s"}, {Language::CHINESE, "包/秒"}}},
+        {"no_request_captured", {{Language::ENGLISH, "No update request was captured"}, {Language::CHINESE, "未抓取到更新请求"}}},
         {"closing_capture_handle", {{Language::ENGLISH, "Closing packet capture handle"}, {Language::CHINESE, "正在关闭抓包句柄"}}},
 
         // Error and confirmation messages
+        {"invalid_numeric_argument", {{Language::ENGLISH, "Invalid numeric argument, using default"}, {Language::CHINESE, "数值参数无效，将使用默认值"}}},
         {"received_signal", {{Language::ENGLISH, "Received signal"}, {Language::CHINESE, "收到信号"}}},
         {"admin_privileges_required", {{Language::ENGLISH, "This action requires administrative privileges. Elevate now?"}, {Language::CHINESE, "此操作需要管理员权限，是否立即提权？"}}},
         {"user_declined_elevation", {{Language::ENGLISH, "User declined to elevate privileges"}, {Language::CHINESE, "用户已拒绝提权"}}},
@@ -164,12 +201,9 @@ namespace I18N
         // Download messages
         {"preparing_modified_request", {{Language::ENGLISH, "Preparing modified request body for OTA check"}, {Language::CHINESE, "正在为 OTA 检查准备修改后的请求数据体"}}},
         {"modified_version_to", {{Language::ENGLISH, "Modified version to"}, {Language::CHINESE, "已将版本修改为"}}},
-        {"initializing_wininet", {{Language::ENGLISH, "Initializing WinINet for HTTP request"}, {Language::CHINESE, "正在初始化 WinINet 以发送 HTTP 请求"}}},
-        {"connecting_to_server", {{Language::ENGLISH, "Connecting to iotapi.abupdate.com"}, {Language::CHINESE, "正在连接到 iotapi.abupdate.com"}}},
         {"opening_http_request_for", {{Language::ENGLISH, "Opening HTTP request for"}, {Language::CHINESE, "正在为以下路径打开 HTTP 请求"}}},
         {"request_body_size", {{Language::ENGLISH, "Request body size"}, {Language::CHINESE, "请求数据体大小"}}},
         {"sending_http_request", {{Language::ENGLISH, "Sending HTTP request..."}, {Language::CHINESE, "正在发送 HTTP 请求..."}}},
-        {"reading_http_response", {{Language::ENGLISH, "Reading HTTP response..."}, {Language::CHINESE, "正在读取 HTTP 响应..."}}},
         {"response_size", {{Language::ENGLISH, "Response size"}, {Language::CHINESE, "响应大小"}}},
         {"parsing_json_response", {{Language::ENGLISH, "Parsing JSON response..."}, {Language::CHINESE, "正在解析 JSON 响应..."}}},
         {"json_response_parsed", {{Language::ENGLISH, "JSON response parsed successfully"}, {Language::CHINESE, "JSON 响应解析成功"}}},
@@ -181,17 +215,121 @@ namespace I18N
         {"download_url", {{Language::ENGLISH, "Download URL"}, {Language::CHINESE, "下载网址"}}},
         {"target_filename", {{Language::ENGLISH, "Target filename"}, {Language::CHINESE, "目标文件名"}}},
         {"download_completed", {{Language::ENGLISH, "Download completed"}, {Language::CHINESE, "下载完成"}}},
-        {"failed_initialize_wininet", {{Language::ENGLISH, "Failed to initialize WinINet"}, {Language::CHINESE, "初始化 WinINet 失败"}}},
-        {"failed_open_url", {{Language::ENGLISH, "Failed to open URL"}, {Language::CHINESE, "打开网址失败"}}},
         {"failed_create_output_file", {{Language::ENGLISH, "Failed to create output file"}, {Language::CHINESE, "创建输出文件失败"}}},
+        {"download_incomplete", {{Language::ENGLISH, "Download incomplete"}, {Language::CHINESE, "下载不完整"}}},
+        {"failed_map_file", {{Language::ENGLISH, "Failed to map file into memory"}, {Language::CHINESE, "映射文件到内存失败"}}},
+        {"set_file_valid_data_failed", {{Language::ENGLISH, "Could not skip zero-filling the output file"}, {Language::CHINESE, "无法跳过输出文件的零填充"}}},
+        {"manage_volume_privilege_enabled", {{Language::ENGLISH, "Volume maintenance privilege enabled, output files are not zero-filled"}, {Language::CHINESE, "已启用卷维护权限，输出文件不进行零填充"}}},
+        {"manage_volume_privilege_unavailable", {{Language::ENGLISH, "Volume maintenance privilege unavailable, output files are zero-filled"}, {Language::CHINESE, "卷维护权限不可用，输出文件将进行零填充"}}},
+        {"failed_fetch_update_data", {{Language::ENGLISH, "Failed to fetch update data"}, {Language::CHINESE, "获取更新数据失败"}}},
+        {"download_probe_failed", {{Language::ENGLISH, "Could not probe the image URL"}, {Language::CHINESE, "无法探测固件网址"}}},
+        {"http_unsupported_url", {{Language::ENGLISH, "Only http:// URLs are supported"}, {Language::CHINESE, "仅支持 http:// 网址"}}},
+        {"http_resolve_failed", {{Language::ENGLISH, "Failed to resolve host"}, {Language::CHINESE, "解析主机失败"}}},
+        {"http_connect_failed", {{Language::ENGLISH, "Failed to connect to server"}, {Language::CHINESE, "连接服务器失败"}}},
+        {"http_send_failed", {{Language::ENGLISH, "Failed to send HTTP request"}, {Language::CHINESE, "发送 HTTP 请求失败"}}},
+        {"http_no_response", {{Language::ENGLISH, "No HTTP response before timeout"}, {Language::CHINESE, "超时前未收到 HTTP 响应"}}},
+        {"http_malformed_response", {{Language::ENGLISH, "Malformed HTTP response"}, {Language::CHINESE, "HTTP 响应格式错误"}}},
+        {"http_body_incomplete", {{Language::ENGLISH, "HTTP response body ended early"}, {Language::CHINESE, "HTTP 响应内容提前结束"}}},
+        {"http_transfer_abandoned", {{Language::ENGLISH, "HTTP transfer abandoned"}, {Language::CHINESE, "HTTP 传输已放弃"}}},
+        {"segment_md5_unreadable", {{Language::ENGLISH, "Cannot read segment MD5 list, only the full image will be verified"}, {Language::CHINESE, "无法读取分段 MD5 列表，仅校验完整固件"}}},
+        {"segment_md5_mismatch", {{Language::ENGLISH, "Segment MD5 mismatch"}, {Language::CHINESE, "分段 MD5 不匹配"}}},
+        {"verified_segments", {{Language::ENGLISH, "verified segments"}, {Language::CHINESE, "个校验分段"}}},
+        {"downloaded_image_md5", {{Language::ENGLISH, "Downloaded image MD5"}, {Language::CHINESE, "下载固件的 MD5"}}},
+        {"downloaded_image_sha", {{Language::ENGLISH, "SHA-1"}, {Language::CHINESE, "SHA-1"}}},
+        {"downloaded_image_hash_mismatch", {{Language::ENGLISH, "Downloaded image does not match the server hashes"}, {Language::CHINESE, "下载的固件与服务器哈希不匹配"}}},
+        {"failed_preallocate_output_file", {{Language::ENGLISH, "Failed to preallocate output file"}, {Language::CHINESE, "预分配输出文件失败"}}},
+        {"content_length", {{Language::ENGLISH, "Content length"}, {Language::CHINESE, "内容长度"}}},
+        {"invalid_content_length", {{Language::ENGLISH, "Ignoring invalid Content-Length"}, {Language::CHINESE, "忽略无效的 Content-Length"}}},
+        {"accept_ranges", {{Language::ENGLISH, "accept ranges"}, {Language::CHINESE, "支持的范围"}}},
+        {"parallel_download", {{Language::ENGLISH, "Starting parallel download"}, {Language::CHINESE, "正在开始并行下载"}}},
+        {"connections", {{Language::ENGLISH, "connections"}, {Language::CHINESE, "个连接"}}},
+        {"chunks", {{Language::ENGLISH, "chunks"}, {Language::CHINESE, "个分块"}}},
+        {"range_download_failed", {{Language::ENGLISH, "Failed to download range"}, {Language::CHINESE, "下载范围失败"}}},
+        {"retrying_range", {{Language::ENGLISH, "Retrying range"}, {Language::CHINESE, "正在重试范围"}}},
+        {"range_request_ignored", {{Language::ENGLISH, "Server ignored the range request"}, {Language::CHINESE, "服务器忽略了范围请求"}}},
+        {"restarting_single_stream", {{Language::ENGLISH, "Server does not honour range requests, restarting as a single stream"}, {Language::CHINESE, "服务器不支持范围请求，改为单流重新下载"}}},
+        {"resuming_download", {{Language::ENGLISH, "Resuming interrupted download, completed"}, {Language::CHINESE, "正在继续中断的下载，已完成"}}},
+        {"download_journal_mismatch", {{Language::ENGLISH, "Remote file changed since the interrupted download, starting over"}, {Language::CHINESE, "远程文件在下载中断后已更改，将重新下载"}}},
+        {"download_journal_corrupted", {{Language::ENGLISH, "Download journal is corrupted, starting over"}, {Language::CHINESE, "下载日志已损坏，将重新下载"}}},
+        {"failed_write_download_journal", {{Language::ENGLISH, "Failed to write download journal"}, {Language::CHINESE, "写入下载日志失败"}}},
         {"could_not_get_content_length", {{Language::ENGLISH, "Could not get content length, proceeding without progress info"}, {Language::CHINESE, "无法获取内容长度，将在无进度信息的情况下继续"}}},
 
+        // Firmware cache messages
+        {"failed_create_cache_directory", {{Language::ENGLISH, "Failed to create cache directory"}, {Language::CHINESE, "创建缓存目录失败"}}},
+        {"cache_index_corrupted", {{Language::ENGLISH, "Cache index is corrupted, starting with an empty cache"}, {Language::CHINESE, "缓存索引已损坏，将使用空缓存"}}},
+        {"failed_write_cache_index", {{Language::ENGLISH, "Failed to write cache index"}, {Language::CHINESE, "写入缓存索引失败"}}},
+        {"evicting_cache_entry", {{Language::ENGLISH, "Evicting cached image"}, {Language::CHINESE, "正在淘汰缓存的固件"}}},
+        {"cache_key", {{Language::ENGLISH, "Firmware cache key"}, {Language::CHINESE, "固件缓存键"}}},
+        {"using_cached_image", {{Language::ENGLISH, "Using cached image file"}, {Language::CHINESE, "正在使用缓存的固件文件"}}},
+        {"cached_image_corrupted", {{Language::ENGLISH, "Cached image failed verification, downloading again"}, {Language::CHINESE, "缓存的固件校验失败，正在重新下载"}}},
+        {"verifying_downloaded_image", {{Language::ENGLISH, "Verifying downloaded image..."}, {Language::CHINESE, "正在校验下载的固件..."}}},
+        {"cloned_cached_image", {{Language::ENGLISH, "Cloned cached image without copying"}, {Language::CHINESE, "已克隆缓存固件，无需复制"}}},
+        {"block_clone_failed", {{Language::ENGLISH, "Block cloning failed, copying instead"}, {Language::CHINESE, "块克隆失败，改为复制"}}},
+        {"served_image_corrupted", {{Language::ENGLISH, "Image to serve does not match the server MD5, it will be downloaded again next time"}, {Language::CHINESE, "待提供的固件与服务器 MD5 不匹配，下次将重新下载"}}},
+        {"calculating_patched_digests", {{Language::ENGLISH, "Calculating digests of the patched image"}, {Language::CHINESE, "正在计算修补后固件的摘要"}}},
+        {"downloaded_image_md5_mismatch", {{Language::ENGLISH, "Downloaded image does not match the server MD5"}, {Language::CHINESE, "下载的固件与服务器 MD5 不匹配"}}},
+        {"prefetching_likely_image", {{Language::ENGLISH, "Prefetching the most served image in the background"}, {Language::CHINESE, "正在后台预取最常用的固件"}}},
+        {"prefetching_image", {{Language::ENGLISH, "Prefetching image"}, {Language::CHINESE, "正在预取固件"}}},
+        {"prefetch_cancelled", {{Language::ENGLISH, "Prefetch cancelled"}, {Language::CHINESE, "预取已取消"}}},
+        {"prefetch_failed", {{Language::ENGLISH, "Prefetch failed"}, {Language::CHINESE, "预取失败"}}},
+        {"prefetch_completed", {{Language::ENGLISH, "Prefetch completed"}, {Language::CHINESE, "预取完成"}}},
+        {"using_learned_password_offset", {{Language::ENGLISH, "Trying password offset learned from an earlier run"}, {Language::CHINESE, "正在尝试之前运行记录的密码偏移"}}},
+        {"found_password_record", {{Language::ENGLISH, "Found password record"}, {Language::CHINESE, "发现密码记录"}}},
+        {"unknown_password_pattern", {{Language::ENGLISH, "Unknown password pattern"}, {Language::CHINESE, "未知的密码模式"}}},
+        {"sha512_crypt_detect_only", {{Language::ENGLISH, "SHA-512 crypt records are only detected; they cannot be replaced"}, {Language::CHINESE, "SHA-512 crypt 记录仅能检测，无法替换"}}},
+        {"sha512_crypt_unsupported", {{Language::ENGLISH, "Cannot generate a SHA-512 crypt record, choose another password pattern"}, {Language::CHINESE, "无法生成 SHA-512 crypt 记录，请选择其他密码模式"}}},
+        {"password_record_length_changed", {{Language::ENGLISH, "New password record would change length"}, {Language::CHINESE, "新的密码记录长度会发生变化"}}},
+        {"debug_lines_dropped", {{Language::ENGLISH, "Debug lines dropped while the console was busy"}, {Language::CHINESE, "控制台繁忙时丢弃的调试信息行数"}}},
+        {"password_search_method", {{Language::ENGLISH, "Password hash located by"}, {Language::CHINESE, "密码哈希定位方式"}}},
+        {"locate_method_hint", {{Language::ENGLISH, "pre-scanned offset"}, {Language::CHINESE, "预扫描的偏移"}}},
+        {"locate_method_filesystem", {{Language::ENGLISH, "ext4 small files"}, {Language::CHINESE, "ext4 小文件"}}},
+        {"locate_method_full_scan", {{Language::ENGLISH, "full image scan"}, {Language::CHINESE, "全镜像扫描"}}},
+        {"found_ext4_filesystem_at", {{Language::ENGLISH, "Found ext4 filesystem at offset"}, {Language::CHINESE, "在偏移处发现 ext4 文件系统"}}},
+        {"filesystem_search_scanned", {{Language::ENGLISH, "Searched small files"}, {Language::CHINESE, "已搜索小文件"}}},
+        {"cached_response_age", {{Language::ENGLISH, "Cached update data age"}, {Language::CHINESE, "缓存的更新数据时长"}}},
+        {"using_cached_update_data", {{Language::ENGLISH, "Using cached update data"}, {Language::CHINESE, "正在使用缓存的更新数据"}}},
+        {"using_stale_update_data", {{Language::ENGLISH, "Server unreachable, using expired cached update data"}, {Language::CHINESE, "无法连接服务器，正在使用已过期的缓存更新数据"}}},
+        {"ota_server_pinned", {{Language::ENGLISH, "OTA server address pinned"}, {Language::CHINESE, "已固定 OTA 服务器地址"}}},
+        {"ota_server_not_pinned", {{Language::ENGLISH, "Cannot resolve OTA server before redirection, only cached update data will work"}, {Language::CHINESE, "重定向前无法解析 OTA 服务器，只能使用缓存的更新数据"}}},
+
+        // Session journal
+        {"resume_previous_session", {{Language::ENGLISH, "An unfinished session was found. Resume it?"}, {Language::CHINESE, "发现未完成的会话，是否继续？"}}},
+        {"resuming_session", {{Language::ENGLISH, "Resuming session"}, {Language::CHINESE, "正在继续会话"}}},
+        {"session_journal_corrupted", {{Language::ENGLISH, "Session journal is corrupted, starting over"}, {Language::CHINESE, "会话日志已损坏，重新开始"}}},
+        {"failed_write_session_journal", {{Language::ENGLISH, "Failed to write session journal"}, {Language::CHINESE, "写入会话日志失败"}}},
+        {"resumed_update_data", {{Language::ENGLISH, "Reusing update data from the previous run"}, {Language::CHINESE, "沿用上次运行的更新数据"}}},
+        {"resumed_image", {{Language::ENGLISH, "Image file from the previous run is intact, skipping download"}, {Language::CHINESE, "上次运行的镜像文件完好，跳过下载"}}},
+        {"resumed_patched_image", {{Language::ENGLISH, "Patched image from the previous run is intact, skipping patch and hashing"}, {Language::CHINESE, "上次运行已修改的镜像完好，跳过修改和哈希计算"}}},
+
+        // Tracing
+        {"trace_written", {{Language::ENGLISH, "Trace written"}, {Language::CHINESE, "性能跟踪已写入"}}},
+        {"cannot_write_trace", {{Language::ENGLISH, "Cannot write trace file"}, {Language::CHINESE, "无法写入跟踪文件"}}},
+
+        // Batch mode
+        {"batch_requires_admin", {{Language::ENGLISH, "Batch mode needs an elevated console, run it as administrator"}, {Language::CHINESE, "批处理模式需要管理员权限，请以管理员身份运行"}}},
+        {"batch_requires_password", {{Language::ENGLISH, "Batch mode needs --password or --password-file"}, {Language::CHINESE, "批处理模式需要 --password 或 --password-file"}}},
+        {"password_file_empty", {{Language::ENGLISH, "Password file has no passwords"}, {Language::CHINESE, "密码文件中没有密码"}}},
+        {"pen_reported_download", {{Language::ENGLISH, "The pen reported its download, exiting"}, {Language::CHINESE, "词典笔已报告下载结果，正在退出"}}},
+        {"pen_report_timeout", {{Language::ENGLISH, "The pen did not report its download in time"}, {Language::CHINESE, "词典笔未在规定时间内报告下载结果"}}},
+
+        // Fleet mode
+        {"fleet_mode_started", {{Language::ENGLISH, "Fleet mode: every pen that checks for updates gets its own job"}, {Language::CHINESE, "批量模式：每支检查更新的词典笔都会获得独立任务"}}},
+        {"fleet_press_x", {{Language::ENGLISH, "Press [x] to stop accepting pens, [s] for capture statistics"}, {Language::CHINESE, "按 [x] 键停止接收词典笔，按 [s] 键查看抓包统计"}}},
+        {"fleet_job_captured", {{Language::ENGLISH, "New pen captured"}, {Language::CHINESE, "抓取到新的词典笔"}}},
+        {"fleet_password_for_job", {{Language::ENGLISH, "New password for pen"}, {Language::CHINESE, "请为词典笔设置新密码"}}},
+        {"fleet_job_downloading", {{Language::ENGLISH, "Fetching update data and image"}, {Language::CHINESE, "正在获取更新数据和镜像"}}},
+        {"fleet_job_ready", {{Language::ENGLISH, "Image ready, the pen can update now"}, {Language::CHINESE, "镜像已就绪，词典笔现在可以更新"}}},
+        {"fleet_job_abandoned", {{Language::ENGLISH, "Stopped before a password was given, job abandoned"}, {Language::CHINESE, "未设置密码即已停止，任务已放弃"}}},
+        {"fleet_job_failed", {{Language::ENGLISH, "Job failed, its pen will not be served"}, {Language::CHINESE, "任务失败，不会为该笔提供服务"}}},
+        {"fleet_waiting_jobs", {{Language::ENGLISH, "Waiting for running jobs to finish"}, {Language::CHINESE, "正在等待运行中的任务完成"}}},
+
         // Hash processing messages
-        {"found_sha256_hash_at", {{Language::ENGLISH, "Found SHA256 hash pattern at position"}, {Language::CHINESE, "在位置找到 SHA256 哈希模式"}}},
-        {"found_md5_hash_at", {{Language::ENGLISH, "Found MD5 hash pattern at position"}, {Language::CHINESE, "在位置找到 MD5 哈希模式"}}},
         {"hash_pattern_search_completed", {{Language::ENGLISH, "Hash pattern search completed, found"}, {Language::CHINESE, "哈希模式搜索完成，共找到"}}},
         {"patterns", {{Language::ENGLISH, "patterns"}, {Language::CHINESE, "个模式"}}},
+        {"files", {{Language::ENGLISH, "files"}, {Language::CHINESE, "个文件"}}},
         {"calculating_md5_for_file", {{Language::ENGLISH, "Calculating MD5 for entire file"}, {Language::CHINESE, "正在计算整个文件的 MD5"}}},
+        {"copying_file_with_md5", {{Language::ENGLISH, "Copying file while calculating MD5"}, {Language::CHINESE, "正在复制文件并计算 MD5"}}},
+        {"cannot_write_file", {{Language::ENGLISH, "Cannot write file"}, {Language::CHINESE, "无法写入文件"}}},
         {"cannot_open_file", {{Language::ENGLISH, "Cannot open file"}, {Language::CHINESE, "无法打开文件"}}},
         {"md5_calculated_for", {{Language::ENGLISH, "MD5 calculated for"}, {Language::CHINESE, "已计算 MD5，文件大小"}}},
         {"calculating_md5_segment", {{Language::ENGLISH, "Calculating MD5 for file segment"}, {Language::CHINESE, "正在计算文件分段的 MD5"}}},
@@ -248,7 +386,12 @@ namespace I18N
         SetConsoleOutputCP(CP_UTF8);
         SetConsoleCP(CP_UTF8);
 
-        if (IO::Confirm("Use Chinese language? / 使用中文界面？"))
+        const std::string language = ARGC::GetArg("lang");
+        if (language == "zh")
+            SetLanguage(Language::CHINESE);
+        else if (language == "en" || ARGC::HasArg("batch"))
+            SetLanguage(Language::ENGLISH);
+        else if (IO::Confirm("Use Chinese language? / 使用中文界面？"))
             SetLanguage(Language::CHINESE);
         else
             SetLanguage(Language::ENGLISH);
@@ -0,0 +1,131 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "image.hpp"
+#include <filesystem>
+
+IMAGE::IMAGE(std::string path) : path(path) {}
+
+std::string IMAGE::getPath()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return path;
+}
+
+std::vector<HASH::PATCH> IMAGE::getPatches()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return patches;
+}
+
+void IMAGE::overlay(std::string basePath, std::vector<HASH::PATCH> patches)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    path = basePath;
+    this->patches = patches;
+}
+
+void IMAGE::setSize(size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sized)
+        return;
+    this->size = size;
+    sized = true;
+    changed.notify_all();
+}
+
+void IMAGE::advance(size_t available)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (available <= this->available)
+        return;
+    this->available = available;
+    changed.notify_all();
+}
+
+void IMAGE::publish(std::string otaData)
+{
+    const size_t fileSize = std::filesystem::file_size(getPath());
+    std::lock_guard<std::mutex> lock(mutex);
+    this->otaData = otaData;
+    size = fileSize;
+    available = fileSize;
+    sized = true;
+    published = true;
+    changed.notify_all();
+}
+
+void IMAGE::report()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    reported = true;
+    changed.notify_all();
+}
+
+void IMAGE::abort()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    failed = true;
+    changed.notify_all();
+}
+
+bool IMAGE::hasFailed()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+bool IMAGE::waitForSize(size_t &size, std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!changed.wait_for(lock, timeout, [this]()
+                          { return sized || failed; }) ||
+        !sized)
+        return false;
+    size = this->size;
+    return true;
+}
+
+bool IMAGE::waitAvailable(size_t end, size_t &available, std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!changed.wait_for(lock, timeout, [this, end]()
+                          { return this->available >= end || failed; }) ||
+        this->available < end)
+        return false;
+    available = this->available;
+    return true;
+}
+
+bool IMAGE::waitForOtaData(std::string &otaData, std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!changed.wait_for(lock, timeout, [this]()
+                          { return published || failed; }) ||
+        !published)
+        return false;
+    otaData = this->otaData;
+    return true;
+}
+
+bool IMAGE::waitReported(std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, timeout, [this]()
+                            { return reported; });
+}
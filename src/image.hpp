@@ -0,0 +1,69 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include "hash.hpp"
+
+// The image handed to the pen, shared between whoever produces it and
+// HTTP_SERVER. In streaming mode the size is known as soon as the download
+// starts and bytes become servable as the patched prefix grows; checkVersion
+// is only answered once the final hashes are published. Otherwise the image
+// may be an overlay: a pristine file served with patches spliced in, so it
+// never has to be copied or rewritten. The pen's download report marks the
+// image as delivered. An aborted image will never be ready; waits on it
+// return false at once, and every wait gives up after its timeout.
+class IMAGE
+{
+public:
+    explicit IMAGE(std::string path);
+
+    std::string getPath();
+    std::vector<HASH::PATCH> getPatches();
+    // Serves basePath with patches applied instead of the image's own path.
+    void overlay(std::string basePath, std::vector<HASH::PATCH> patches);
+    void setSize(size_t size);
+    void advance(size_t available);
+    void publish(std::string otaData);
+    void report();
+    void abort();
+    bool hasFailed();
+
+    bool waitForSize(size_t &size, std::chrono::seconds timeout);
+    // Sets the servable prefix, at least end bytes long.
+    bool waitAvailable(size_t end, size_t &available, std::chrono::seconds timeout);
+    bool waitForOtaData(std::string &otaData, std::chrono::seconds timeout);
+    bool waitReported(std::chrono::seconds timeout);
+
+private:
+    std::mutex mutex;
+    std::string path;
+    std::vector<HASH::PATCH> patches;
+    std::condition_variable changed;
+    bool sized = false;
+    size_t size = 0;
+    size_t available = 0;
+    bool published = false;
+    std::string otaData;
+    bool reported = false;
+    bool failed = false;
+};
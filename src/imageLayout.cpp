@@ -0,0 +1,214 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "imageLayout.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include <algorithm>
+#include <cstring>
+
+uint16_t IMAGE_LAYOUT::read16(const unsigned char *data, size_t size, size_t offset)
+{
+    if (offset > size || size - offset < 2)
+        return 0;
+    return static_cast<uint16_t>(data[offset] | data[offset + 1] << 8);
+}
+
+uint32_t IMAGE_LAYOUT::read32(const unsigned char *data, size_t size, size_t offset)
+{
+    if (offset > size || size - offset < 4)
+        return 0;
+    return read16(data, size, offset) | static_cast<uint32_t>(read16(data, size, offset + 2)) << 16;
+}
+
+uint64_t IMAGE_LAYOUT::read64(const unsigned char *data, size_t size, size_t offset)
+{
+    if (offset > size || size - offset < 8)
+        return 0;
+    return read32(data, size, offset) | static_cast<uint64_t>(read32(data, size, offset + 4)) << 32;
+}
+
+std::vector<size_t> IMAGE_LAYOUT::partitionStarts(const unsigned char *data, size_t size)
+{
+    // A bare filesystem image has no partition table; try offset 0 first.
+    std::vector<size_t> starts = {0};
+    if (read16(data, size, 510) != 0xAA55)
+        return starts;
+    for (size_t entry = 446; entry < 510; entry += 16)
+    {
+        const uint8_t type = data[entry + 4];
+        const uint64_t firstLba = read32(data, size, entry + 8);
+        if (type == 0xEE)
+        {
+            // Protective MBR: the real table is the GPT at LBA 1.
+            const size_t header = SECTOR_SIZE;
+            if (header + 92 > size || std::memcmp(data + header, "EFI PART", 8) != 0)
+                continue;
+            const uint64_t entriesLba = read64(data, size, header + 72);
+            const uint32_t entryCount = read32(data, size, header + 80);
+            const uint32_t entrySize = read32(data, size, header + 84);
+            for (uint32_t i = 0; i < entryCount && entrySize >= 48; i++)
+            {
+                const uint64_t gptEntry = entriesLba * SECTOR_SIZE + static_cast<uint64_t>(i) * entrySize;
+                if (gptEntry + 48 > size)
+                    break;
+                const uint64_t start = read64(data, size, gptEntry + 32);
+                if (start != 0)
+                    starts.push_back(start * SECTOR_SIZE);
+            }
+        }
+        else if (type != 0 && firstLba != 0)
+            starts.push_back(firstLba * SECTOR_SIZE);
+    }
+    return starts;
+}
+
+bool IMAGE_LAYOUT::isExt4(const unsigned char *data, size_t size, size_t start)
+{
+    return start < size && read16(data, size, start + SUPERBLOCK_OFFSET + 0x38) == EXT4_MAGIC;
+}
+
+bool IMAGE_LAYOUT::smallFileRanges(const unsigned char *data, size_t size, std::vector<RANGE> &ranges, size_t &files)
+{
+    bool found = false;
+    files = 0;
+    for (size_t start : partitionStarts(data, size))
+    {
+        if (!isExt4(data, size, start))
+            continue;
+        const size_t superblock = start + SUPERBLOCK_OFFSET;
+        const uint32_t logBlockSize = read32(data, size, superblock + 0x18);
+        if (logBlockSize > 6)
+            continue;
+        EXT4 fs;
+        fs.data = data;
+        fs.size = size;
+        fs.start = start;
+        fs.blockSize = static_cast<size_t>(1024) << logBlockSize;
+        fs.has64Bit = (read32(data, size, superblock + 0x60) & INCOMPAT_64BIT) != 0;
+        IO_DEBUG(t("found_ext4_filesystem_at") + ": " + std::to_string(start));
+        ext4FileRanges(fs, ranges, files);
+        found = true;
+    }
+    return found;
+}
+
+void IMAGE_LAYOUT::ext4FileRanges(const EXT4 &fs, std::vector<RANGE> &ranges, size_t &files)
+{
+    const size_t superblock = fs.start + SUPERBLOCK_OFFSET;
+    const uint32_t inodesCount = read32(fs.data, fs.size, superblock + 0x0);
+    const uint32_t firstDataBlock = read32(fs.data, fs.size, superblock + 0x14);
+    const uint32_t inodesPerGroup = read32(fs.data, fs.size, superblock + 0x28);
+    const uint32_t revision = read32(fs.data, fs.size, superblock + 0x4C);
+    const size_t inodeSize = revision >= 1 ? read16(fs.data, fs.size, superblock + 0x58) : 128;
+    const uint32_t roCompat = read32(fs.data, fs.size, superblock + 0x64);
+    const size_t descriptorSize = fs.has64Bit ? std::max<size_t>(32, read16(fs.data, fs.size, superblock + 0xFE)) : 32;
+    // Unused inodes at the end of each table are only tracked with checksums.
+    const bool trustUnused = (roCompat & (RO_COMPAT_GDT_CSUM | RO_COMPAT_METADATA_CSUM)) != 0;
+    if (inodesPerGroup == 0 || inodeSize < 128)
+        return;
+
+    const uint32_t groups = (inodesCount + inodesPerGroup - 1) / inodesPerGroup;
+    const size_t descriptors = fs.start + (static_cast<size_t>(firstDataBlock) + 1) * fs.blockSize;
+    for (uint32_t group = 0; group < groups; group++)
+    {
+        const size_t descriptor = descriptors + group * descriptorSize;
+        if (descriptor + descriptorSize > fs.size)
+            break;
+        const uint16_t flags = read16(fs.data, fs.size, descriptor + 0x12);
+        if (flags & BG_INODE_UNINIT)
+            continue;
+        uint64_t table = read32(fs.data, fs.size, descriptor + 0x8);
+        if (fs.has64Bit && descriptorSize >= 64)
+            table |= static_cast<uint64_t>(read32(fs.data, fs.size, descriptor + 0x28)) << 32;
+        uint32_t used = inodesPerGroup;
+        if (trustUnused)
+            used -= std::min<uint32_t>(used, read16(fs.data, fs.size, descriptor + 0x1C));
+
+        for (uint32_t index = 0; index < used; index++)
+        {
+            const size_t inode = fs.start + table * fs.blockSize + static_cast<size_t>(index) * inodeSize;
+            if (inode + 128 > fs.size)
+                break;
+            const uint16_t mode = read16(fs.data, fs.size, inode + 0x0);
+            const uint16_t links = read16(fs.data, fs.size, inode + 0x1A);
+            const uint32_t inodeFlags = read32(fs.data, fs.size, inode + 0x20);
+            if ((mode & MODE_TYPE_MASK) != MODE_REGULAR || links == 0 || (inodeFlags & INLINE_DATA_FL))
+                continue;
+            uint64_t remaining = read32(fs.data, fs.size, inode + 0x4) | static_cast<uint64_t>(read32(fs.data, fs.size, inode + 0x6C)) << 32;
+            if (remaining == 0 || remaining > MAX_SMALL_FILE)
+                continue;
+            files++;
+            if (inodeFlags & EXTENTS_FL)
+                extentRanges(fs, inode + 0x28, 60, 0, remaining, ranges);
+            else
+                blockMapRanges(fs, inode, remaining, ranges);
+        }
+    }
+}
+
+void IMAGE_LAYOUT::addBlocks(const EXT4 &fs, uint64_t block, uint64_t count, uint64_t &remaining, std::vector<RANGE> &ranges)
+{
+    // The last block is cut at the file size; what lies beyond is slack.
+    const uint64_t offset = fs.start + block * fs.blockSize;
+    const uint64_t length = std::min<uint64_t>(count * fs.blockSize, remaining);
+    remaining -= length;
+    if (block == 0 || offset >= fs.size)
+        return;
+    ranges.push_back({static_cast<size_t>(offset), static_cast<size_t>(std::min<uint64_t>(length, fs.size - offset))});
+}
+
+void IMAGE_LAYOUT::extentRanges(const EXT4 &fs, size_t node, size_t nodeSize, int depth, uint64_t &remaining, std::vector<RANGE> &ranges)
+{
+    if (read16(fs.data, fs.size, node) != EXTENT_MAGIC || depth > EXTENT_MAX_DEPTH)
+        return;
+    const uint16_t entries = std::min<uint16_t>(read16(fs.data, fs.size, node + 2), (nodeSize - 12) / 12);
+    const uint16_t treeDepth = read16(fs.data, fs.size, node + 6);
+    for (uint16_t i = 0; i < entries && remaining > 0; i++)
+    {
+        const size_t entry = node + 12 + i * 12;
+        if (treeDepth == 0)
+        {
+            uint16_t length = read16(fs.data, fs.size, entry + 4);
+            const uint64_t start = read32(fs.data, fs.size, entry + 8) | static_cast<uint64_t>(read16(fs.data, fs.size, entry + 6)) << 32;
+            // Uninitialized extents read as zeros and hold no text.
+            if (length > EXTENT_MAX_INITIALIZED)
+            {
+                length -= EXTENT_MAX_INITIALIZED;
+                remaining -= std::min<uint64_t>(remaining, static_cast<uint64_t>(length) * fs.blockSize);
+                continue;
+            }
+            addBlocks(fs, start, length, remaining, ranges);
+        }
+        else
+        {
+            const uint64_t leaf = read32(fs.data, fs.size, entry + 4) | static_cast<uint64_t>(read16(fs.data, fs.size, entry + 8)) << 32;
+            extentRanges(fs, fs.start + leaf * fs.blockSize, fs.blockSize, depth + 1, remaining, ranges);
+        }
+    }
+}
+
+void IMAGE_LAYOUT::blockMapRanges(const EXT4 &fs, size_t inode, uint64_t &remaining, std::vector<RANGE> &ranges)
+{
+    // Twelve direct blocks and one indirect block cover every small file
+    // with 4 KiB blocks; anything larger is left to the full scan.
+    for (size_t i = 0; i < 12 && remaining > 0; i++)
+        addBlocks(fs, read32(fs.data, fs.size, inode + 0x28 + i * 4), 1, remaining, ranges);
+    const uint64_t indirect = fs.start + static_cast<uint64_t>(read32(fs.data, fs.size, inode + 0x28 + 12 * 4)) * fs.blockSize;
+    for (size_t i = 0; i < fs.blockSize / 4 && remaining > 0 && indirect > fs.start; i++)
+        addBlocks(fs, read32(fs.data, fs.size, indirect + i * 4), 1, remaining, ranges);
+}
@@ -0,0 +1,79 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads just enough of a firmware image's partition table (MBR or GPT) and
+// ext4 metadata to tell where small regular files keep their data, so a
+// search for text in configuration files and scripts touches those blocks
+// instead of the whole image. Only pages actually read are faulted in from
+// the mapping. Squashfs and other compressed filesystems are not walked:
+// their contents cannot be patched in place anyway.
+class IMAGE_LAYOUT
+{
+public:
+    struct RANGE
+    {
+        size_t offset;
+        size_t length;
+    };
+    // Files larger than this are not configuration files.
+    static constexpr size_t MAX_SMALL_FILE = 1024 * 1024;
+
+    // False when no ext4 filesystem was found; ranges are image offsets.
+    static bool smallFileRanges(const unsigned char *data, size_t size, std::vector<RANGE> &ranges, size_t &files);
+
+private:
+    // Little-endian on-disk fields; see the ext4 disk layout documentation.
+    static constexpr size_t SUPERBLOCK_OFFSET = 1024;
+    static constexpr uint16_t EXT4_MAGIC = 0xEF53;
+    static constexpr uint32_t INCOMPAT_64BIT = 0x80;
+    static constexpr uint16_t BG_INODE_UNINIT = 0x1;
+    static constexpr uint32_t RO_COMPAT_GDT_CSUM = 0x10;
+    static constexpr uint32_t RO_COMPAT_METADATA_CSUM = 0x400;
+    static constexpr uint16_t MODE_TYPE_MASK = 0xF000;
+    static constexpr uint16_t MODE_REGULAR = 0x8000;
+    static constexpr uint32_t EXTENTS_FL = 0x80000;
+    static constexpr uint32_t INLINE_DATA_FL = 0x10000000;
+    static constexpr uint16_t EXTENT_MAGIC = 0xF30A;
+    static constexpr uint16_t EXTENT_MAX_INITIALIZED = 32768;
+    static constexpr int EXTENT_MAX_DEPTH = 5;
+    static constexpr size_t SECTOR_SIZE = 512;
+
+    struct EXT4
+    {
+        const unsigned char *data;
+        size_t size;
+        size_t start;
+        size_t blockSize;
+        bool has64Bit;
+    };
+
+    static uint16_t read16(const unsigned char *data, size_t size, size_t offset);
+    static uint32_t read32(const unsigned char *data, size_t size, size_t offset);
+    static uint64_t read64(const unsigned char *data, size_t size, size_t offset);
+    static std::vector<size_t> partitionStarts(const unsigned char *data, size_t size);
+    static bool isExt4(const unsigned char *data, size_t size, size_t start);
+    static void ext4FileRanges(const EXT4 &fs, std::vector<RANGE> &ranges, size_t &files);
+    static void addBlocks(const EXT4 &fs, uint64_t block, uint64_t count, uint64_t &remaining, std::vector<RANGE> &ranges);
+    static void extentRanges(const EXT4 &fs, size_t node, size_t nodeSize, int depth, uint64_t &remaining, std::vector<RANGE> &ranges);
+    static void blockMapRanges(const EXT4 &fs, size_t inode, uint64_t &remaining, std::vector<RANGE> &ranges);
+};
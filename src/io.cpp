@@ -22,6 +22,100 @@
 #include <iomanip>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
+
+bool IO::verbose = false;
+std::unique_ptr<RING_BUFFER<IO::RECORD>> IO::queue;
+std::thread IO::writer;
+std::atomic<bool> IO::running(false);
+std::atomic<size_t> IO::posted(0);
+std::atomic<size_t> IO::written(0);
+std::atomic<size_t> IO::dropped(0);
+std::mutex IO::wakeMutex;
+std::condition_variable IO::wake;
+
+void IO::Initialize()
+{
+    verbose = ARGC::HasArg("verbose");
+    queue.reset(new RING_BUFFER<RECORD>(QUEUE_CAPACITY));
+    running.store(true, std::memory_order_release);
+    writer = std::thread(RunWriter);
+    std::atexit(StopWriter);
+}
+
+void IO::RunWriter()
+{
+    while (true)
+    {
+        const bool stopping = !running.load(std::memory_order_acquire);
+        while (queue->tryPop([](RECORD &record)
+                             { Write(record.level, record.message); record.message.clear(); }))
+            written.fetch_add(1, std::memory_order_release);
+        if (const size_t count = dropped.exchange(0, std::memory_order_relaxed))
+            Write(WARN_LEVEL, t("debug_lines_dropped") + ": " + std::to_string(count));
+        if (stopping)
+            return;
+        // Producers notify without the lock; the timeout covers a missed wakeup.
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::milliseconds(50), []()
+                      { return written.load(std::memory_order_acquire) < posted.load(std::memory_order_acquire) ||
+                               !running.load(std::memory_order_acquire); });
+    }
+}
+
+void IO::StopWriter()
+{
+    if (!running.exchange(false, std::memory_order_acq_rel))
+        return;
+    wake.notify_one();
+    if (writer.joinable())
+        writer.join();
+}
+
+void IO::Post(LEVEL level, std::string message)
+{
+    if (!running.load(std::memory_order_acquire))
+    {
+        Write(level, message);
+        return;
+    }
+    // When the writer falls behind, debug lines are dropped and counted;
+    // anything more important waits for room.
+    while (!queue->tryPush([&](RECORD &record)
+                           { record.level = level; record.message = std::move(message); }))
+    {
+        if (level == DEBUG_LEVEL)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+    posted.fetch_add(1, std::memory_order_release);
+    wake.notify_one();
+}
+
+void IO::Drain()
+{
+    if (std::this_thread::get_id() == writer.get_id())
+        return;
+    while (running.load(std::memory_order_acquire) &&
+           written.load(std::memory_order_acquire) < posted.load(std::memory_order_acquire))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void IO::Write(LEVEL level, const std::string &message)
+{
+    static const WORD colors[] = {
+        FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE,
+        FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+        FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+        FOREGROUND_RED | FOREGROUND_INTENSITY};
+    static const char *prefixes[] = {"debug_prefix", "info_prefix", "warn_prefix", "error_prefix"};
+    SetColor(colors[level]);
+    std::cout << t(prefixes[level]) << " " << message << std::endl;
+    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+}
 
 void IO::SetColor(WORD color)
 {
@@ -31,6 +125,7 @@ void IO::SetColor(WORD color)
 
 BOOL IO::Confirm(std::string message)
 {
+    Drain();
     SetColor(FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
     std::cout << t("confirm_prefix") << " " << message << " " << t("confirm_suffix") << " " << std::flush;
     char res = _getch();
@@ -41,6 +136,7 @@ BOOL IO::Confirm(std::string message)
 
 void IO::Input(std::string message, std::string &input)
 {
+    Drain();
     SetColor(FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
     std::cout << t("input_prefix") << " " << message << std::flush;
     std::getline(std::cin, input);
@@ -49,32 +145,24 @@ void IO::Input(std::string message, std::string &input)
 
 void IO::Debug(std::string message)
 {
-    if (!ARGC::HasArg("verbose"))
+    if (!verbose)
         return;
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-    std::cout << t("debug_prefix") << " " << message << std::endl;
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+    Post(DEBUG_LEVEL, std::move(message));
 }
 
 void IO::Info(std::string message)
 {
-    SetColor(FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-    std::cout << t("info_prefix") << " " << message << std::endl;
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+    Post(INFO_LEVEL, std::move(message));
 }
 
 void IO::Warn(std::string message)
 {
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-    std::cout << t("warn_prefix") << " " << message << std::endl;
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+    Post(WARN_LEVEL, std::move(message));
 }
 
 void IO::Error(std::string message)
 {
-    SetColor(FOREGROUND_RED | FOREGROUND_INTENSITY);
-    std::cout << t("error_prefix") << " " << message << std::endl;
-    SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+    Post(ERROR_LEVEL, std::move(message));
 }
 
 void IO::ShowProgress(double percentage, size_t downloaded, size_t total)
@@ -90,6 +178,7 @@ void IO::ShowProgress(double percentage, size_t downloaded, size_t total)
 
     lastPercentage = percentage;
     lastUpdateTime = now;
+    Drain();
 
     int barWidth = 50;
     int filledWidth = static_cast<int>(percentage * barWidth / 100.0);
@@ -132,6 +221,7 @@ void IO::ShowProgress(double percentage, size_t downloaded, size_t total)
 
 void IO::FlushProgress()
 {
+    Drain();
     std::cout << std::endl;
     SetColor(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
 }
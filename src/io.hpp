@@ -21,13 +21,65 @@
 #include <iostream>
 #include <windows.h>
 #include <limits>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ringBuffer.hpp"
 
+// Builds the message only when --verbose is on, so debug lines on hot
+// paths cost a branch on a cached flag when it is off.
+#define IO_DEBUG(message)       \
+    do                          \
+    {                           \
+        if (IO::IsVerbose())    \
+            IO::Debug(message); \
+    } while (0)
+
+// Console output. After Initialize, log lines are queued to a writer
+// thread, so callers never wait on the console; prompts and the progress
+// bar drain the queue first to keep the output in order.
 class IO
 {
 private:
+    enum LEVEL
+    {
+        DEBUG_LEVEL,
+        INFO_LEVEL,
+        WARN_LEVEL,
+        ERROR_LEVEL
+    };
+    struct RECORD
+    {
+        LEVEL level;
+        std::string message;
+    };
+    static constexpr size_t QUEUE_CAPACITY = 4096;
+
+    static bool verbose;
+    static std::unique_ptr<RING_BUFFER<RECORD>> queue;
+    static std::thread writer;
+    static std::atomic<bool> running;
+    static std::atomic<size_t> posted;
+    static std::atomic<size_t> written;
+    static std::atomic<size_t> dropped;
+    static std::mutex wakeMutex;
+    static std::condition_variable wake;
+
     static void SetColor(WORD color);
+    static void Write(LEVEL level, const std::string &message);
+    static void Post(LEVEL level, std::string message);
+    static void RunWriter();
+    static void StopWriter();
 
 public:
+    // Caches --verbose and starts the writer; call right after ARGC.
+    static void Initialize();
+    static bool IsVerbose() { return verbose; }
+    // Returns once everything logged so far is on the console.
+    static void Drain();
+
     static BOOL Confirm(std::string message);
     static void Input(std::string message, std::string &input);
     static void Debug(std::string message);
@@ -25,23 +25,73 @@
 #include "i18n.hpp"
 #include "argc.hpp"
 #include "host.hpp"
+#include "cache.hpp"
+#include "image.hpp"
+#include "patcher.hpp"
+#include "fleet.hpp"
+#include "trace.hpp"
+#include "session.hpp"
 #include <fstream>
+#include <thread>
+#include <atomic>
 #include <filesystem>
 
 int main(int argc, char *argv[])
 {
     ARGC::Initialize(argc, argv);
+    IO::Initialize();
+    TRACE::Initialize();
     const std::string imageFile = ARGC::GetArg("image", "image.img");
     I18N::Initialize();
-    IO::Debug(t("app_starting"));
+    IO_DEBUG(t("app_starting"));
 
     CORE::BindSignal();
     CORE::Header();
     CORE::ElevateNow();
+
+    if (ARGC::HasArg("fleet"))
+    {
+        FLEET fleet(imageFile);
+        fleet.run();
+        IO_DEBUG(t("app_terminating"));
+        if (!ARGC::HasArg("batch"))
+            _getch();
+        return 0;
+    }
+
+    // A run that died part way resumes at its first unfinished stage.
+    SESSION session(imageFile);
+    session.resume();
+
     CAPTURE::CAPTURE_RESULT result;
-    CAPTURE capturer;
-    IO::Debug(t("starting_packet_capture"));
-    capturer.capture(result);
+    if (!session.hasCapture(result))
+    {
+        // While waiting for a pen, fetch the image the station served most.
+        std::atomic<bool> cancelPrefetch(false);
+        std::string prefetchKey;
+        nlohmann::json prefetchResponse;
+        std::thread prefetcher;
+        if (!ARGC::HasArg("no-prefetch") && !ARGC::HasArg("no-cache") && CACHE::mostServed(prefetchKey, prefetchResponse))
+            prefetcher = std::thread(
+                [&]()
+                {
+                    const nlohmann::json &version = prefetchResponse["data"]["version"];
+                    CACHE::prefetch(version["deltaUrl"], DOWNLOAD::parseExpectedHashes(version), cancelPrefetch);
+                });
+
+        CAPTURE capturer;
+        IO_DEBUG(t("starting_packet_capture"));
+        capturer.capture(result);
+        if (prefetcher.joinable())
+        {
+            // A guess for another product would only compete for bandwidth.
+            if (CACHE::responseKey(result.productUrl, result.request_body.value("version", "")) != prefetchKey)
+                cancelPrefetch = true;
+            prefetcher.join();
+        }
+        session.recordCapture(result);
+    }
+    const std::string responseKey = CACHE::responseKey(result.productUrl, result.request_body.value("version", ""));
     // result.productUrl = "/product/1708583443/f730c7fa72bd3871/ota/checkVersion";
     // result.request_body = nlohmann::json::parse(R"({ "timestamp": 1755184821, "sign": "4f2a475cdb69b45f76c5fa3cde2fd4ff", "mid": "7E92000008705369", "productId": "1708583443", "version": "4.7.7", "networkType": "WIFI" })");
     //     result.productUrl = "/product/1700649481/8b2d1ce6a5d9e922/ota/checkVersion";
@@ -53,32 +103,118 @@ int main(int argc, char *argv[])
     //  "version": "1.0.0",
     //  "networkType": "WIFI"
     // })");
-    auto updateData = DOWNLOAD::getUpdateData(result);
+    nlohmann::json updateData;
+    if (!session.hasUpdateData(updateData))
+    {
+        updateData = DOWNLOAD::getUpdateData(result);
+        session.recordUpdateData(updateData);
+    }
     std::string deltaUrl = updateData["data"]["version"]["deltaUrl"];
-    IO::Debug(t("delta_url_extracted") + ": " + deltaUrl);
-    DOWNLOAD::downloadFile(deltaUrl, imageFile);
-    HASH::replaceHash(imageFile);
-    IO::Info(t("calculating_hash"));
+    IO_DEBUG(t("delta_url_extracted") + ": " + deltaUrl);
+    const DOWNLOAD::EXPECTED_HASHES expected = DOWNLOAD::parseExpectedHashes(updateData["data"]["version"]);
     auto segmentMd5 = nlohmann::json::parse(std::string(updateData["data"]["version"]["segmentMd5"]));
-    for (auto &md5 : segmentMd5)
-        md5["md5"] = HASH::MD5FileSegment(imageFile, md5["startpos"], md5["endpos"]);
+    IMAGE image(imageFile);
+    const std::string otaUrl = result.productUrl.substr(0, result.productUrl.find_last_of('/'));
+    HTTP_SERVER httpServer(80);
+    httpServer.addRoute(otaUrl, "/image.img", image);
+    // The image is served as an overlay: a pristine file with the new
+    // password hash spliced in by the server, so a cached image is never
+    // copied or rewritten.
+    std::string basePath;
+    HASH::PATCH patch;
+    nlohmann::json digests;
+    bool serverStarted = false;
+    const bool resumed = session.hasPatch(basePath, patch, digests);
+    if (!resumed && ARGC::HasArg("stream"))
+    {
+        // The server is up while the image downloads; patching and hashing
+        // follow the verified prefix, and checkVersion waits for the result.
+        PATCHER patcher(HASH::readNewPassword(), segmentMd5);
+        HOST::enable();
+        httpServer.start();
+        serverStarted = true;
+        CACHE::prepareImage(deltaUrl, expected, imageFile,
+                            [&](unsigned char *data, size_t available, size_t size)
+                            {
+                                image.setSize(size);
+                                image.advance(patcher.consume(data, available, size));
+                            });
+        std::string md5, sha1;
+        patcher.finish(md5, sha1, segmentMd5);
+        basePath = imageFile;
+        patch = patcher.getPatch();
+        digests = {{"md5sum", md5}, {"sha", sha1}, {"segmentMd5", segmentMd5}};
+        session.recordImage(basePath, true);
+        session.recordPatch(patch, digests);
+    }
+    else if (!resumed)
+    {
+        if (!session.hasImage(basePath))
+        {
+            basePath = CACHE::locateImage(deltaUrl, expected, imageFile);
+            session.recordImage(basePath, basePath == imageFile);
+        }
+        const std::string hintKey = CACHE::hintKey(result.productUrl, result.request_body.value("version", ""), expected.md5sum);
+        size_t hintOffset = 0, hintLength = 0;
+        CACHE::lookupPasswordOffset(hintKey, deltaUrl, expected.md5sum, hintOffset, hintLength);
+        const std::pair<size_t, size_t> position = HASH::locatePassword(basePath, hintOffset, hintLength);
+        CACHE::recordPasswordOffset(hintKey, position.first, position.second);
+        patch = HASH::patchFor(basePath, position, HASH::readNewPassword());
+        IO::Info(t("calculating_hash"));
+        std::string md5, sha1, pristineMd5;
+        HASH::digestPatched(basePath, {patch}, segmentMd5, md5, sha1, pristineMd5);
+        if (!expected.md5sum.empty() && pristineMd5 != expected.md5sum)
+        {
+            if (basePath != imageFile)
+                CACHE::invalidate(deltaUrl, expected.md5sum);
+            DIE(t("served_image_corrupted") + ": " + pristineMd5 + " != " + expected.md5sum);
+        }
+        digests = {{"md5sum", md5}, {"sha", sha1}, {"segmentMd5", segmentMd5}};
+        session.recordPatch(patch, digests);
+    }
+    segmentMd5 = digests["segmentMd5"];
+    updateData["data"]["version"]["md5sum"] = digests["md5sum"];
+    updateData["data"]["version"]["sha"] = digests["sha"];
+    image.overlay(basePath, {patch});
     updateData["data"]["version"]["segmentMd5"] = segmentMd5.dump();
-    IO::Debug(t("calculating_full_md5"));
-    updateData["data"]["version"]["md5sum"] = HASH::MD5File(imageFile);
-    updateData["data"]["version"]["sha"] = HASH::SHA1File(imageFile);
     updateData["data"]["version"]["deltaUrl"] =
         updateData["data"]["version"]["bakUrl"] =
             "http://192.168.137.1/image.img";
 
-    IO::Debug(updateData.dump(2, ' '));
-    HOST::enable();
-    HTTP_SERVER httpServer(80, imageFile, updateData.dump(), result.productUrl.substr(0, result.productUrl.find_last_of('/')));
-    httpServer.start();
-    while (_getch() != 'x')
-        ;
+    IO_DEBUG(updateData.dump(2, ' '));
+    image.publish(updateData.dump());
+    CACHE::recordServed(responseKey);
+    if (!serverStarted)
+    {
+        HOST::enable();
+        httpServer.start();
+    }
+    int exitCode = 0;
+    TRACE::SCOPE serving("serve");
+    if (ARGC::HasArg("batch"))
+    {
+        // Done once the pen reports its download; no keypress needed.
+        if (image.waitReported(std::chrono::seconds(ARGC::GetIntArg("batch-timeout", 1800))))
+        {
+            IO::Info(t("pen_reported_download"));
+            session.finish();
+        }
+        else
+        {
+            IO::Error(t("pen_report_timeout"));
+            exitCode = EXIT_PEN_TIMEOUT;
+        }
+    }
+    else
+    {
+        while (_getch() != 'x')
+            ;
+        session.finish();
+    }
     httpServer.stop();
     HOST::disable();
-    IO::Debug(t("app_terminating"));
-    _getch();
-    return 0;
+    IO_DEBUG(t("app_terminating"));
+    if (!ARGC::HasArg("batch"))
+        _getch();
+    return exitCode;
 }
@@ -0,0 +1,181 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "mappedFile.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include <winioctl.h>
+#include <filesystem>
+#include <mutex>
+
+MAPPED_FILE::MAPPED_FILE(const std::string &filename, MODE mode)
+{
+    hFile = CreateFile(filename.c_str(), mode == WRITE ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                       mode == READ_SHARED ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        DIE(t("cannot_open_file") + ": " + filename);
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize))
+        DIE(t("cannot_open_file") + ": " + filename);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    map(filename, mode == WRITE);
+}
+
+MAPPED_FILE::MAPPED_FILE(const std::string &filename, size_t size, bool sparse)
+{
+    // OPEN_ALWAYS keeps the bytes of an interrupted download for resuming.
+    // A sparse file must start over: whatever is not written reads as zero.
+    hFile = CreateFile(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                       sparse ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        DIE(t("failed_create_output_file") + ": " + filename);
+    if (sparse)
+    {
+        // Without sparse support (FAT) the file is merely zero-filled, never
+        // exposed through SetFileValidData, so skipped pages still read zero.
+        DWORD returned = 0;
+        DeviceIoControl(hFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+        LARGE_INTEGER fileSize;
+        fileSize.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(hFile, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+            DIE(t("failed_preallocate_output_file") + ": " + filename);
+    }
+    else
+        preallocate(hFile, filename, size);
+    length = size;
+    map(filename, true);
+}
+
+MAPPED_FILE::~MAPPED_FILE()
+{
+    if (view)
+        UnmapViewOfFile(view);
+    if (hMapping)
+        CloseHandle(hMapping);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+}
+
+void MAPPED_FILE::map(const std::string &filename, bool writable)
+{
+    // Zero-length files cannot be mapped; they simply have no view.
+    if (length == 0)
+        return;
+    const uint64_t mappingSize = static_cast<uint64_t>(length);
+    hMapping = CreateFileMapping(hFile, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                 static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize & 0xFFFFFFFF), NULL);
+    if (!hMapping)
+        DIE(t("failed_map_file") + ": " + filename + " (" + std::to_string(GetLastError()) + ")");
+    view = static_cast<unsigned char *>(MapViewOfFile(hMapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length));
+    if (!view)
+        DIE(t("failed_map_file") + ": " + filename + " (" + std::to_string(GetLastError()) + ")");
+}
+
+void MAPPED_FILE::flush(size_t offset, size_t count)
+{
+    if (!view || offset >= length)
+        return;
+    FlushViewOfFile(view + offset, std::min(count, length - offset));
+    FlushFileBuffers(hFile);
+}
+
+void MAPPED_FILE::preallocate(HANDLE hFile, const std::string &filename, size_t size)
+{
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(hFile, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+        DIE(t("failed_preallocate_output_file") + ": " + filename);
+    // Without this NTFS zero-fills everything up to the first page written
+    // out of order. Every byte is overwritten by the download anyway.
+    if (enableManageVolumePrivilege() && !SetFileValidData(hFile, fileSize.QuadPart))
+        IO_DEBUG(t("set_file_valid_data_failed") + ": " + std::to_string(GetLastError()));
+}
+
+bool MAPPED_FILE::enableManageVolumePrivilege()
+{
+    static std::once_flag once;
+    static bool enabled = false;
+    std::call_once(once, []()
+                   {
+        HANDLE hToken;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+            return;
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValue(NULL, SE_MANAGE_VOLUME_NAME, &privileges.Privileges[0].Luid) &&
+            AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) &&
+            GetLastError() == ERROR_SUCCESS)
+            enabled = true;
+        CloseHandle(hToken);
+        IO_DEBUG(t(enabled ? "manage_volume_privilege_enabled" : "manage_volume_privilege_unavailable")); });
+    return enabled;
+}
+
+bool MAPPED_FILE::clone(const std::string &source, const std::string &destination)
+{
+    HANDLE hSource = CreateFile(source.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hSource == INVALID_HANDLE_VALUE)
+        return false;
+    // Only ReFS answers this, and clones must be cut at its cluster size.
+    FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity = {};
+    DWORD returned = 0;
+    LARGE_INTEGER sourceSize;
+    if (!DeviceIoControl(hSource, FSCTL_GET_INTEGRITY_INFORMATION, NULL, 0, &integrity, sizeof(integrity), &returned, NULL) ||
+        integrity.ClusterSizeInBytes == 0 || !GetFileSizeEx(hSource, &sourceSize))
+    {
+        CloseHandle(hSource);
+        return false;
+    }
+    HANDLE hDestination = CreateFile(destination.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hDestination == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hSource);
+        return false;
+    }
+
+    // The last cluster is cloned whole into a file rounded up to the
+    // cluster size, which is then cut back to the source's length.
+    const LONGLONG clusterSize = integrity.ClusterSizeInBytes;
+    LARGE_INTEGER roundedSize;
+    roundedSize.QuadPart = (sourceSize.QuadPart + clusterSize - 1) / clusterSize * clusterSize;
+    bool cloned = SetFilePointerEx(hDestination, roundedSize, NULL, FILE_BEGIN) && SetEndOfFile(hDestination);
+    // A single request must stay below 4 GiB.
+    const LONGLONG chunkSize = (1LL << 31) / clusterSize * clusterSize;
+    for (LONGLONG offset = 0; cloned && offset < roundedSize.QuadPart; offset += chunkSize)
+    {
+        DUPLICATE_EXTENTS_DATA extents = {};
+        extents.FileHandle = hSource;
+        extents.SourceFileOffset.QuadPart = offset;
+        extents.TargetFileOffset.QuadPart = offset;
+        extents.ByteCount.QuadPart = std::min(chunkSize, roundedSize.QuadPart - offset);
+        cloned = DeviceIoControl(hDestination, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents), NULL, 0, &returned, NULL);
+    }
+    cloned = cloned && SetFilePointerEx(hDestination, sourceSize, NULL, FILE_BEGIN) && SetEndOfFile(hDestination);
+    if (!cloned)
+        IO_DEBUG(t("block_clone_failed") + ": " + std::to_string(GetLastError()));
+    CloseHandle(hDestination);
+    CloseHandle(hSource);
+    if (!cloned)
+    {
+        std::error_code error;
+        std::filesystem::remove(destination, error);
+    }
+    return cloned;
+}
@@ -0,0 +1,63 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+// A whole file mapped into memory. Readers see the same page-cache pages the
+// downloader wrote, so hashing and scanning a fresh image never goes back to
+// disk. The sizing constructor preallocates the file to its final length
+// before anything is written, keeping it in as few extents as possible; a
+// sparse file instead starts empty and only takes space for pages written.
+class MAPPED_FILE
+{
+public:
+    enum MODE
+    {
+        READ,
+        WRITE,
+        // Read-only, tolerating a writer that still has the file open.
+        READ_SHARED,
+    };
+
+    MAPPED_FILE(const std::string &filename, MODE mode);
+    MAPPED_FILE(const std::string &filename, size_t size, bool sparse = false);
+    ~MAPPED_FILE();
+    MAPPED_FILE(const MAPPED_FILE &) = delete;
+    MAPPED_FILE &operator=(const MAPPED_FILE &) = delete;
+
+    unsigned char *data() const { return view; }
+    size_t size() const { return length; }
+    void flush(size_t offset, size_t count);
+
+    // Makes destination share the source's clusters where the volume
+    // supports block cloning (ReFS), so the copy takes no time or space
+    // until one side is written. False, leaving nothing behind, elsewhere.
+    static bool clone(const std::string &source, const std::string &destination);
+
+private:
+    void map(const std::string &filename, bool writable);
+    static void preallocate(HANDLE hFile, const std::string &filename, size_t size);
+    static bool enableManageVolumePrivilege();
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+    unsigned char *view = nullptr;
+    size_t length = 0;
+};
@@ -0,0 +1,96 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "metrics.hpp"
+#include "capture.hpp"
+#include <sstream>
+
+const double METRICS::HISTOGRAM::BOUNDS_SECONDS[BUCKET_COUNT - 1] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60};
+const char *const METRICS::ENDPOINT_NAMES[ENDPOINT_COUNT] = {
+    "image", "register", "checkVersion", "reportDownResult", "metrics", "unknown"};
+
+void METRICS::HISTOGRAM::observe(double seconds)
+{
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && seconds > BOUNDS_SECONDS[bucket])
+        bucket++;
+    buckets[bucket].add();
+    count.add();
+    sumMicroseconds.add(static_cast<uint64_t>(seconds * 1e6));
+}
+
+static void header(std::ostringstream &out, const char *name, const char *type, const char *help)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string METRICS::render() const
+{
+    std::ostringstream out;
+    header(out, "paper_http_active_connections", "gauge", "Client connections being handled.");
+    out << "paper_http_active_connections " << activeConnections.get() << "\n";
+    header(out, "paper_http_image_transfers", "gauge", "Image transfers in flight.");
+    out << "paper_http_image_transfers " << imageTransfers.get() << "\n";
+    header(out, "paper_http_connections_total", "counter", "Client connections accepted.");
+    out << "paper_http_connections_total " << acceptedConnections.get() << "\n";
+    header(out, "paper_http_sent_bytes_total", "counter", "Bytes sent to clients, headers included.");
+    out << "paper_http_sent_bytes_total " << bytesServed.get() << "\n";
+
+    header(out, "paper_http_requests_total", "counter", "Requests handled, by endpoint.");
+    for (int endpoint = 0; endpoint < ENDPOINT_COUNT; endpoint++)
+        out << "paper_http_requests_total{endpoint=\"" << ENDPOINT_NAMES[endpoint] << "\"} " << requests[endpoint].get() << "\n";
+
+    header(out, "paper_http_request_duration_seconds", "histogram", "Time to handle a request, by endpoint.");
+    for (int endpoint = 0; endpoint < ENDPOINT_COUNT; endpoint++)
+    {
+        const HISTOGRAM &histogram = latency[endpoint];
+        const std::string labels = std::string("endpoint=\"") + ENDPOINT_NAMES[endpoint] + "\"";
+        uint64_t cumulative = 0;
+        for (int bucket = 0; bucket < HISTOGRAM::BUCKET_COUNT; bucket++)
+        {
+            cumulative += histogram.buckets[bucket].get();
+            out << "paper_http_request_duration_seconds_bucket{" << labels << ",le=\"";
+            if (bucket < HISTOGRAM::BUCKET_COUNT - 1)
+                out << HISTOGRAM::BOUNDS_SECONDS[bucket];
+            else
+                out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "paper_http_request_duration_seconds_sum{" << labels << "} " << histogram.sumMicroseconds.get() / 1e6 << "\n";
+        out << "paper_http_request_duration_seconds_count{" << labels << "} " << histogram.count.get() << "\n";
+    }
+
+    const CAPTURE::STATISTICS &capture = CAPTURE::getStatistics();
+    header(out, "paper_capture_packets_received_total", "counter", "Packets handed over by the capture driver.");
+    out << "paper_capture_packets_received_total " << capture.received.load(std::memory_order_relaxed) << "\n";
+    header(out, "paper_capture_packets_processed_total", "counter", "Packets inspected by the consumer.");
+    out << "paper_capture_packets_processed_total " << capture.processed.load(std::memory_order_relaxed) << "\n";
+    header(out, "paper_capture_requests_matched_total", "counter", "checkVersion requests recognized.");
+    out << "paper_capture_requests_matched_total " << capture.matched.load(std::memory_order_relaxed) << "\n";
+    header(out, "paper_capture_packets_rejected_total", "counter", "Packets rejected, by reason.");
+    static const char *const rejectionNames[CAPTURE::REJECTION_COUNT] = {
+        "truncated", "non_ip", "non_tcp", "invalid_tcp_header", "wrong_port", "empty_payload", "no_match"};
+    for (int reason = 0; reason < CAPTURE::REJECTION_COUNT; reason++)
+        out << "paper_capture_packets_rejected_total{reason=\"" << rejectionNames[reason] << "\"} "
+            << capture.rejections[reason].load(std::memory_order_relaxed) << "\n";
+    header(out, "paper_capture_kernel_dropped_total", "counter", "Packets dropped by the driver or the interface.");
+    out << "paper_capture_kernel_dropped_total{where=\"driver\"} " << capture.kernelDropped.load(std::memory_order_relaxed) << "\n";
+    out << "paper_capture_kernel_dropped_total{where=\"interface\"} " << capture.interfaceDropped.load(std::memory_order_relaxed) << "\n";
+    return out.str();
+}
@@ -0,0 +1,93 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Counters behind HTTP_SERVER's /metrics, rendered in Prometheus text
+// format together with the capture counters. Every counter owns a cache
+// line, so client threads updating different ones never contend.
+class METRICS
+{
+public:
+    enum ENDPOINT
+    {
+        IMAGE_ENDPOINT,
+        REGISTER_ENDPOINT,
+        CHECK_VERSION_ENDPOINT,
+        REPORT_ENDPOINT,
+        METRICS_ENDPOINT,
+        UNKNOWN_ENDPOINT,
+        ENDPOINT_COUNT
+    };
+
+    struct alignas(64) COUNTER
+    {
+        std::atomic<uint64_t> value{0};
+
+        void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    struct alignas(64) GAUGE
+    {
+        std::atomic<int64_t> value{0};
+
+        int64_t get() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    // Raises a gauge for as long as it lives.
+    class HOLD
+    {
+    public:
+        explicit HOLD(GAUGE &gauge) : gauge(gauge) { gauge.value.fetch_add(1, std::memory_order_relaxed); }
+        ~HOLD() { gauge.value.fetch_sub(1, std::memory_order_relaxed); }
+        HOLD(const HOLD &) = delete;
+        HOLD &operator=(const HOLD &) = delete;
+
+    private:
+        GAUGE &gauge;
+    };
+
+    struct HISTOGRAM
+    {
+        static constexpr int BUCKET_COUNT = 12;
+        static const double BOUNDS_SECONDS[BUCKET_COUNT - 1];
+
+        // Per bucket, not cumulative; render() accumulates.
+        COUNTER buckets[BUCKET_COUNT];
+        COUNTER count;
+        COUNTER sumMicroseconds;
+
+        void observe(double seconds);
+    };
+
+    GAUGE activeConnections;
+    GAUGE imageTransfers;
+    COUNTER acceptedConnections;
+    COUNTER bytesServed;
+    COUNTER requests[ENDPOINT_COUNT];
+    HISTOGRAM latency[ENDPOINT_COUNT];
+
+    std::string render() const;
+
+private:
+    static const char *const ENDPOINT_NAMES[ENDPOINT_COUNT];
+};
@@ -1,56 +0,0 @@
-// Copyright (C) 2025 Langning Chen
-//
-// This file is part of paper.
-//
-// paper is free software: you can redistribute it and/or modify
-// it under the terms of the GNU General Public License as published by
-// the Free Software Foundation, either version 3 of the License, or
-// (at your option) any later version.
-//
-// paper is distributed in the hope that it will be useful,
-// but WITHOUT ANY WARRANTY; without even the implied warranty of
-// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-// GNU General Public License for more details.
-//
-// You should have received a copy of the GNU General Public License
-// along with paper.  If not, see <https://www.gnu.org/licenses/>.
-
-#pragma once
-
-#include <winsock2.h>
-#include <windows.h>
-#include <iphlpapi.h>
-#include <ws2tcpip.h>
-
-struct eth_header
-{
-    u_char ether_dhost[6];
-    u_char ether_shost[6];
-    u_short ether_type;
-};
-
-struct ip_header
-{
-    unsigned char ip_hl_v;
-    unsigned char ip_tos;
-    unsigned short ip_len;
-    unsigned short ip_id;
-    unsigned short ip_off;
-    unsigned char ip_ttl;
-    unsigned char ip_p;
-    unsigned short ip_sum;
-    struct in_addr ip_src, ip_dst;
-};
-
-struct tcp_header
-{
-    unsigned short th_sport;
-    unsigned short th_dport;
-    unsigned int th_seq;
-    unsigned int th_ack;
-    unsigned char th_offx2;
-    unsigned char th_flags;
-    unsigned short th_win;
-    unsigned short th_sum;
-    unsigned short th_urp;
-};
@@ -0,0 +1,241 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <pcap/dlt.h>
+
+// Link-to-TCP parsers specialized per datalink type. select() is called once
+// per capture handle; the returned function never re-checks the link type and
+// reads every header field byte-wise, so no struct is ever cast onto an
+// unaligned packet buffer.
+class PACKET_PARSER
+{
+public:
+    enum VERDICT
+    {
+        ACCEPTED,
+        TRUNCATED,
+        NON_IP,
+        NON_TCP,
+        INVALID_TCP_HEADER,
+    };
+
+    struct SEGMENT
+    {
+        const unsigned char *payload;
+        size_t length;
+        uint16_t sourcePort;
+        uint16_t destinationPort;
+    };
+
+    typedef VERDICT (*PARSE_FUNCTION)(const unsigned char *data, size_t length, SEGMENT &segment);
+
+    static PARSE_FUNCTION select(int linkType);
+
+private:
+    static const uint16_t ETHERTYPE_IPV4 = 0x0800;
+    static const uint16_t ETHERTYPE_IPV6 = 0x86DD;
+    static const uint16_t ETHERTYPE_VLAN = 0x8100;
+    static const uint16_t ETHERTYPE_QINQ = 0x88A8;
+    static const uint8_t PROTOCOL_TCP = 6;
+
+    static uint16_t readU16(const unsigned char *data) { return static_cast<uint16_t>((data[0] << 8) | data[1]); }
+
+    // Each link layer yields the offset of the network header and its
+    // EtherType; raw captures derive the EtherType from the IP version nibble.
+    template <int LINK_TYPE>
+    struct LINK_LAYER;
+
+    template <int LINK_TYPE>
+    static VERDICT parse(const unsigned char *data, size_t length, SEGMENT &segment)
+    {
+        size_t offset = 0;
+        uint16_t etherType = 0;
+        if (!LINK_LAYER<LINK_TYPE>::parse(data, length, offset, etherType))
+            return TRUNCATED;
+        if (etherType == ETHERTYPE_IPV4)
+            return parseIPv4(data + offset, length - offset, segment);
+        if (etherType == ETHERTYPE_IPV6)
+            return parseIPv6(data + offset, length - offset, segment);
+        return NON_IP;
+    }
+
+    static uint16_t etherTypeFromVersion(const unsigned char *data, size_t length)
+    {
+        if (length < 1)
+            return 0;
+        const unsigned char version = data[0] >> 4;
+        return version == 4 ? ETHERTYPE_IPV4 : version == 6 ? ETHERTYPE_IPV6 : 0;
+    }
+
+    static VERDICT parseIPv4(const unsigned char *data, size_t length, SEGMENT &segment)
+    {
+        if (length < 20)
+            return TRUNCATED;
+        if ((data[0] >> 4) != 4)
+            return NON_IP;
+        if (data[9] != PROTOCOL_TCP)
+            return NON_TCP;
+        const size_t headerLength = (data[0] & 0x0F) * 4u;
+        if (headerLength < 20 || headerLength > length)
+            return TRUNCATED;
+        // Anything past the datagram is link-layer padding, not payload.
+        const size_t totalLength = readU16(data + 2);
+        if (totalLength < headerLength || totalLength > length)
+            return TRUNCATED;
+        return parseTCP(data + headerLength, totalLength - headerLength, segment);
+    }
+
+    static VERDICT parseIPv6(const unsigned char *data, size_t length, SEGMENT &segment)
+    {
+        if (length < 40)
+            return TRUNCATED;
+        if ((data[0] >> 4) != 6)
+            return NON_IP;
+        const size_t datagramLength = 40u + readU16(data + 4);
+        if (datagramLength > length)
+            return TRUNCATED;
+        length = datagramLength;
+        uint8_t nextHeader = data[6];
+        size_t offset = 40;
+        // Hop-by-hop, routing and destination options share the same
+        // (next header, length in 8-octet units) layout.
+        while (nextHeader == 0 || nextHeader == 43 || nextHeader == 60)
+        {
+            if (offset + 8 > length)
+                return TRUNCATED;
+            nextHeader = data[offset];
+            offset += (data[offset + 1] + 1u) * 8u;
+        }
+        if (nextHeader != PROTOCOL_TCP)
+            return NON_TCP;
+        if (offset > length)
+            return TRUNCATED;
+        return parseTCP(data + offset, length - offset, segment);
+    }
+
+    static VERDICT parseTCP(const unsigned char *data, size_t length, SEGMENT &segment)
+    {
+        if (length < 20)
+            return TRUNCATED;
+        const size_t headerLength = (data[12] >> 4) * 4u;
+        if (headerLength < 20)
+            return INVALID_TCP_HEADER;
+        if (headerLength > length)
+            return TRUNCATED;
+        segment.sourcePort = readU16(data);
+        segment.destinationPort = readU16(data + 2);
+        segment.payload = data + headerLength;
+        segment.length = length - headerLength;
+        return ACCEPTED;
+    }
+};
+
+template <>
+struct PACKET_PARSER::LINK_LAYER<DLT_NULL>
+{
+    static bool parse(const unsigned char *data, size_t length, size_t &offset, uint16_t &etherType)
+    {
+        if (length < 4)
+            return false;
+        offset = 4;
+        etherType = etherTypeFromVersion(data + offset, length - offset);
+        return true;
+    }
+};
+
+template <>
+struct PACKET_PARSER::LINK_LAYER<DLT_EN10MB>
+{
+    static bool parse(const unsigned char *data, size_t length, size_t &offset, uint16_t &etherType)
+    {
+        if (length < 14)
+            return false;
+        offset = 14;
+        etherType = readU16(data + 12);
+        // 802.1Q / 802.1ad tags, at most two (QinQ).
+        for (int tags = 0; tags < 2 && (etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ); tags++)
+        {
+            if (length < offset + 4)
+                return false;
+            etherType = readU16(data + offset + 2);
+            offset += 4;
+        }
+        return true;
+    }
+};
+
+template <>
+struct PACKET_PARSER::LINK_LAYER<DLT_LINUX_SLL>
+{
+    static bool parse(const unsigned char *data, size_t length, size_t &offset, uint16_t &etherType)
+    {
+        if (length < 16)
+            return false;
+        offset = 16;
+        etherType = readU16(data + 14);
+        return true;
+    }
+};
+
+template <>
+struct PACKET_PARSER::LINK_LAYER<DLT_LINUX_SLL2>
+{
+    static bool parse(const unsigned char *data, size_t length, size_t &offset, uint16_t &etherType)
+    {
+        if (length < 20)
+            return false;
+        offset = 20;
+        etherType = readU16(data);
+        return true;
+    }
+};
+
+template <>
+struct PACKET_PARSER::LINK_LAYER<DLT_RAW>
+{
+    static bool parse(const unsigned char *data, size_t length, size_t &offset, uint16_t &etherType)
+    {
+        offset = 0;
+        etherType = etherTypeFromVersion(data, length);
+        return length > 0;
+    }
+};
+
+inline PACKET_PARSER::PARSE_FUNCTION PACKET_PARSER::select(int linkType)
+{
+    switch (linkType)
+    {
+    case DLT_NULL:
+        return &parse<DLT_NULL>;
+    case DLT_EN10MB:
+        return &parse<DLT_EN10MB>;
+    case DLT_LINUX_SLL:
+        return &parse<DLT_LINUX_SLL>;
+    case DLT_LINUX_SLL2:
+        return &parse<DLT_LINUX_SLL2>;
+    case DLT_RAW:
+    case DLT_IPV4:
+    case DLT_IPV6:
+        return &parse<DLT_RAW>;
+    default:
+        return nullptr;
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "patcher.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include <algorithm>
+#include <cstring>
+
+PATCHER::PATCHER(std::string password, const nlohmann::json &segmentMd5)
+    : password(password), segmentList(segmentMd5)
+{
+    for (const auto &segment : segmentList)
+        segments.push_back({segment["startpos"], segment["endpos"], std::make_unique<HASH::STREAM>(false), ""});
+}
+
+size_t PATCHER::consume(unsigned char *data, size_t available, size_t size)
+{
+    this->size = size;
+    const size_t limit = available >= size ? size : (available > LOOKAHEAD ? available - LOOKAHEAD : 0);
+    if (limit <= frontier)
+        return frontier;
+
+    // Patch first: every byte a pattern starting below limit can touch is
+    // already present, and nothing below limit changes afterwards.
+    PATTERN_SCANNER::configured().scan(reinterpret_cast<const char *>(data), frontier, limit, available,
+                                       [&](const PATTERN_SCANNER::MATCH &match)
+                                       {
+                                           if (++patches > 1)
+                                               DIE(t("multiple_password_patterns"));
+                                           IO_DEBUG(t("found_password_at_offset") + " " + std::to_string(match.offset));
+                                           const std::string record(reinterpret_cast<const char *>(data) + match.offset, match.length);
+                                           const std::string newHash = HASH::hashForPassword(password, record);
+                                           std::memcpy(data + match.offset, newHash.data(), newHash.size());
+                                           patch = {match.offset, newHash};
+                                       });
+
+    digest.update(data + frontier, limit - frontier);
+    for (auto &segment : segments)
+    {
+        if (!segment.digest)
+            continue;
+        const size_t begin = std::max(frontier, segment.start);
+        const size_t end = std::min(limit, std::min(segment.end, size));
+        if (begin < end)
+            segment.digest->update(data + begin, end - begin);
+        if (std::min(segment.end, size) <= limit)
+        {
+            std::string unused;
+            segment.digest->finish(segment.md5, unused);
+            segment.digest.reset();
+        }
+    }
+    frontier = limit;
+    return frontier;
+}
+
+void PATCHER::finish(std::string &md5, std::string &sha1, nlohmann::json &segmentMd5)
+{
+    if (frontier != size)
+        DIE(t("download_incomplete") + ": " + std::to_string(frontier) + "/" + std::to_string(size));
+    if (patches == 0)
+        DIE(t("no_passwords_found"));
+    digest.finish(md5, sha1);
+    segmentMd5 = segmentList;
+    for (size_t i = 0; i < segments.size(); i++)
+        segmentMd5[i]["md5"] = segments[i].md5;
+    IO_DEBUG(t("password_hash_replacement_completed"));
+}
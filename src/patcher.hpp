@@ -0,0 +1,60 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "json.hpp"
+#include "hash.hpp"
+#include "patternScanner.hpp"
+
+// Finds and patches the password hash and computes the hashes the pen will
+// check, all in one pass over a growing prefix of the image. consume() may
+// be called with a different mapping each time; only offsets are kept.
+class PATCHER
+{
+public:
+    PATCHER(std::string password, const nlohmann::json &segmentMd5);
+
+    size_t consume(unsigned char *data, size_t available, size_t size);
+    void finish(std::string &md5, std::string &sha1, nlohmann::json &segmentMd5);
+    // Where the hash was replaced and the bytes written over it.
+    const HASH::PATCH &getPatch() const { return patch; }
+
+private:
+    // A record starting before the frontier ends at most this far past it.
+    static constexpr size_t LOOKAHEAD = PATTERN_SCANNER::MAX_RECORD;
+
+    struct SEGMENT
+    {
+        size_t start;
+        size_t end;
+        std::unique_ptr<HASH::STREAM> digest;
+        std::string md5;
+    };
+
+    const std::string password;
+    nlohmann::json segmentList;
+    std::vector<SEGMENT> segments;
+    HASH::STREAM digest;
+    size_t size = 0;
+    size_t frontier = 0;
+    size_t patches = 0;
+    HASH::PATCH patch;
+};
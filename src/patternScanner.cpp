@@ -0,0 +1,233 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "patternScanner.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include "argc.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <queue>
+#include <sstream>
+
+const PATTERN_SCANNER::FORMAT_INFO PATTERN_SCANNER::FORMATS[FORMAT_COUNT] = {
+    {"sha256sum", "#", matchSha256sum},
+    {"md5sum", "= \"", matchMd5sum},
+    {"md5crypt", "$1$", matchMd5Crypt},
+    {"sha256crypt", "$5$", matchSha256Crypt},
+    {"sha512crypt", "$6$", matchSha512Crypt},
+};
+
+PATTERN_SCANNER::PATTERN_SCANNER(const std::vector<FORMAT> &formats)
+{
+    // Trie of the anchors, then failure links breadth first; next[] is
+    // completed into a full transition table so scanning never backtracks.
+    states.emplace_back();
+    std::fill(std::begin(states[0].next), std::end(states[0].next), -1);
+    for (FORMAT format : formats)
+    {
+        int state = 0;
+        for (const char *c = FORMATS[format].anchor; *c; c++)
+        {
+            const unsigned char byte = static_cast<unsigned char>(*c);
+            if (states[state].next[byte] < 0)
+            {
+                states[state].next[byte] = static_cast<int>(states.size());
+                states.emplace_back();
+                std::fill(std::begin(states.back().next), std::end(states.back().next), -1);
+            }
+            state = states[state].next[byte];
+        }
+        states[state].outputs.push_back(format);
+        longestAnchor = std::max(longestAnchor, std::strlen(FORMATS[format].anchor));
+    }
+
+    std::queue<int> pending;
+    for (int &next : states[0].next)
+    {
+        if (next < 0)
+            next = 0;
+        else
+        {
+            states[next].fail = 0;
+            pending.push(next);
+        }
+    }
+    while (!pending.empty())
+    {
+        const int state = pending.front();
+        pending.pop();
+        const int fail = states[state].fail;
+        states[state].outputs.insert(states[state].outputs.end(), states[fail].outputs.begin(), states[fail].outputs.end());
+        for (int byte = 0; byte < 256; byte++)
+        {
+            const int next = states[state].next[byte];
+            if (next < 0)
+                states[state].next[byte] = states[fail].next[byte];
+            else
+            {
+                states[next].fail = states[fail].next[byte];
+                pending.push(next);
+            }
+        }
+    }
+}
+
+const PATTERN_SCANNER &PATTERN_SCANNER::configured()
+{
+    static const PATTERN_SCANNER scanner([]()
+                                         {
+        std::vector<FORMAT> formats;
+        std::stringstream names(ARGC::GetArg("patterns", "sha256sum,md5sum"));
+        std::string name;
+        while (std::getline(names, name, ','))
+        {
+            int format = 0;
+            while (format < FORMAT_COUNT && name != FORMATS[format].name)
+                format++;
+            if (format == FORMAT_COUNT)
+                DIE(t("unknown_password_pattern") + ": " + name);
+            if (format == SHA512_CRYPT)
+                IO::Warn(t("sha512_crypt_detect_only"));
+            formats.push_back(static_cast<FORMAT>(format));
+        }
+        return formats; }());
+    return scanner;
+}
+
+const char *PATTERN_SCANNER::formatName(FORMAT format)
+{
+    return FORMATS[format].name;
+}
+
+PATTERN_SCANNER::FORMAT PATTERN_SCANNER::identify(const std::string &record)
+{
+    if (record.compare(0, 3, "$1$") == 0)
+        return MD5_CRYPT;
+    if (record.compare(0, 3, "$5$") == 0)
+        return SHA256_CRYPT;
+    if (record.compare(0, 3, "$6$") == 0)
+        return SHA512_CRYPT;
+    return record.length() == 64 ? SHA256SUM : MD5SUM;
+}
+
+void PATTERN_SCANNER::scan(const char *data, size_t start, size_t end, size_t size, const MATCH_CALLBACK &onMatch) const
+{
+    // Anchors starting below end may finish a little past it.
+    const size_t stop = std::min(size, end + longestAnchor - 1);
+    int state = 0;
+    for (size_t i = start; i < stop; i++)
+    {
+        state = states[state].next[static_cast<unsigned char>(data[i])];
+        for (FORMAT format : states[state].outputs)
+        {
+            const size_t anchor = i + 1 - std::strlen(FORMATS[format].anchor);
+            MATCH match;
+            if (anchor < end && FORMATS[format].match(data, anchor, size, match))
+            {
+                IO_DEBUG(t("found_password_record") + " (" + FORMATS[format].name + "): " + std::to_string(match.offset));
+                onMatch(match);
+            }
+        }
+    }
+}
+
+bool PATTERN_SCANNER::isHex(const char *data, size_t position, size_t size, size_t length)
+{
+    if (position + length > size)
+        return false;
+    for (size_t i = 0; i < length; i++)
+        if (!std::isxdigit(static_cast<unsigned char>(data[position + i])))
+            return false;
+    return true;
+}
+
+bool PATTERN_SCANNER::isCrypt64(char c)
+{
+    return c == '.' || c == '/' || std::isalnum(static_cast<unsigned char>(c));
+}
+
+bool PATTERN_SCANNER::matchSha256sum(const char *data, size_t position, size_t size, MATCH &match)
+{
+    // `#<sha256>  -`: the digest as printed by sha256sum for standard input.
+    if (position + 67 >= size || !isHex(data, position + 1, size, 64) || std::memcmp(data + position + 65, "  -", 3) != 0)
+        return false;
+    match = {position + 1, 64, SHA256SUM};
+    return true;
+}
+
+bool PATTERN_SCANNER::matchMd5sum(const char *data, size_t position, size_t size, MATCH &match)
+{
+    // `= "<md5>  -"`: the same from md5sum.
+    if (position + 38 >= size || !isHex(data, position + 3, size, 32) || std::memcmp(data + position + 35, "  -\"", 4) != 0)
+        return false;
+    match = {position + 3, 32, MD5SUM};
+    return true;
+}
+
+bool PATTERN_SCANNER::matchCrypt(const char *data, size_t position, size_t size, size_t maxSalt, size_t hashLength, bool withRounds,
+                                 MATCH &match)
+{
+    // `$id$[rounds=N$]salt$hash`, ended by anything that cannot continue it.
+    size_t i = position + 3;
+    if (withRounds && i + 7 <= size && std::memcmp(data + i, "rounds=", 7) == 0)
+    {
+        size_t digits = 0;
+        for (i += 7; i < size && digits < 9 && std::isdigit(static_cast<unsigned char>(data[i])); i++)
+            digits++;
+        if (digits == 0 || i >= size || data[i++] != '$')
+            return false;
+    }
+    const size_t salt = i;
+    while (i < size && i - salt <= maxSalt && data[i] != '$' && isCrypt64(data[i]))
+        i++;
+    if (i == salt || i - salt > maxSalt || i >= size || data[i++] != '$')
+        return false;
+    for (size_t end = i + hashLength; i < end; i++)
+        if (i >= size || !isCrypt64(data[i]))
+            return false;
+    if (i < size && isCrypt64(data[i]))
+        return false;
+    match = {position, i - position, MD5_CRYPT};
+    return true;
+}
+
+bool PATTERN_SCANNER::matchMd5Crypt(const char *data, size_t position, size_t size, MATCH &match)
+{
+    if (!matchCrypt(data, position, size, 8, 22, false, match))
+        return false;
+    match.format = MD5_CRYPT;
+    return true;
+}
+
+bool PATTERN_SCANNER::matchSha256Crypt(const char *data, size_t position, size_t size, MATCH &match)
+{
+    if (!matchCrypt(data, position, size, 16, 43, true, match))
+        return false;
+    match.format = SHA256_CRYPT;
+    return true;
+}
+
+bool PATTERN_SCANNER::matchSha512Crypt(const char *data, size_t position, size_t size, MATCH &match)
+{
+    if (!matchCrypt(data, position, size, 16, 86, true, match))
+        return false;
+    match.format = SHA512_CRYPT;
+    return true;
+}
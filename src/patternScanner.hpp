@@ -0,0 +1,94 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Finds password records in an image. Every enabled format starts with a
+// short anchor; the anchors are compiled into one Aho-Corasick automaton,
+// so the image is walked once however many formats are enabled, and a
+// format's own check only runs where its anchor occurs. --patterns picks
+// the formats; crypt-style records are opt-in because shadow files often
+// hold several of them.
+class PATTERN_SCANNER
+{
+public:
+    enum FORMAT
+    {
+        SHA256SUM,
+        MD5SUM,
+        MD5_CRYPT,
+        SHA256_CRYPT,
+        SHA512_CRYPT,
+        FORMAT_COUNT
+    };
+    // The record is [offset, offset + length); that span is what gets
+    // replaced, so a new record must have the same length.
+    struct MATCH
+    {
+        size_t offset;
+        size_t length;
+        FORMAT format;
+    };
+    typedef std::function<void(const MATCH &match)> MATCH_CALLBACK;
+
+    // A record ends at most this far past the first byte of its anchor.
+    static constexpr size_t MAX_RECORD = 128;
+    // A record starts at most this far past the first byte of its anchor.
+    static constexpr size_t MAX_LEAD = 3;
+
+    explicit PATTERN_SCANNER(const std::vector<FORMAT> &formats);
+    // The formats named by --patterns, compiled once.
+    static const PATTERN_SCANNER &configured();
+    static const char *formatName(FORMAT format);
+    // Which format a record found by a scanner is in.
+    static FORMAT identify(const std::string &record);
+
+    // Reports records whose anchor starts in [start, end), in order. Records
+    // may extend past end up to size.
+    void scan(const char *data, size_t start, size_t end, size_t size, const MATCH_CALLBACK &onMatch) const;
+
+private:
+    struct FORMAT_INFO
+    {
+        const char *name;
+        const char *anchor;
+        bool (*match)(const char *data, size_t position, size_t size, MATCH &match);
+    };
+    struct STATE
+    {
+        int next[256];
+        int fail = 0;
+        std::vector<FORMAT> outputs;
+    };
+    static const FORMAT_INFO FORMATS[FORMAT_COUNT];
+
+    static bool isHex(const char *data, size_t position, size_t size, size_t length);
+    static bool isCrypt64(char c);
+    static bool matchSha256sum(const char *data, size_t position, size_t size, MATCH &match);
+    static bool matchMd5sum(const char *data, size_t position, size_t size, MATCH &match);
+    static bool matchCrypt(const char *data, size_t position, size_t size, size_t maxSalt, size_t hashLength, bool withRounds, MATCH &match);
+    static bool matchMd5Crypt(const char *data, size_t position, size_t size, MATCH &match);
+    static bool matchSha256Crypt(const char *data, size_t position, size_t size, MATCH &match);
+    static bool matchSha512Crypt(const char *data, size_t position, size_t size, MATCH &match);
+
+    std::vector<STATE> states;
+    size_t longestAnchor = 0;
+};
@@ -0,0 +1,134 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded lock-free queue (Vyukov's sequence-number ring). Any number of
+// producers and consumers may call tryPush/tryPop concurrently; slots are
+// filled and drained in place so large elements are never copied.
+template <typename T>
+class RING_BUFFER
+{
+public:
+    explicit RING_BUFFER(size_t requestedCapacity)
+        : capacity(roundUpPowerOfTwo(requestedCapacity)), mask(capacity - 1), slots(new SLOT[capacity])
+    {
+        for (size_t i = 0; i < capacity; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    template <typename FILL>
+    bool tryPush(FILL &&fill)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            SLOT &slot = slots[position & mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    fill(slot.value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    const size_t currentHead = head.load(std::memory_order_relaxed);
+                    if (position + 1 > currentHead)
+                        updateHighWater(position + 1 - currentHead);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    template <typename CONSUME>
+    bool tryPop(CONSUME &&consume)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            SLOT &slot = slots[position & mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    consume(slot.value);
+                    slot.sequence.store(position + capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false;
+            else
+                position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t getCapacity() const { return capacity; }
+    size_t getOccupancy() const
+    {
+        const size_t currentTail = tail.load(std::memory_order_relaxed);
+        const size_t currentHead = head.load(std::memory_order_relaxed);
+        return currentTail > currentHead ? currentTail - currentHead : 0;
+    }
+    size_t getHighWater() const { return highWater.load(std::memory_order_relaxed); }
+    size_t getOverflows() const { return overflows.load(std::memory_order_relaxed); }
+
+private:
+    struct SLOT
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundUpPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    void updateHighWater(size_t occupancy)
+    {
+        size_t previous = highWater.load(std::memory_order_relaxed);
+        while (occupancy > previous &&
+               !highWater.compare_exchange_weak(previous, occupancy, std::memory_order_relaxed))
+            ;
+    }
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<SLOT[]> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> highWater{0};
+    std::atomic<size_t> overflows{0};
+};
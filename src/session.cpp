@@ -0,0 +1,178 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "define.hpp"
+#include "session.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include "argc.hpp"
+#include "mappedFile.hpp"
+#include <fstream>
+#include <filesystem>
+
+SESSION::SESSION(std::string imageFile)
+    : journalFile(imageFile + ".session"), journal(nlohmann::json::object())
+{
+}
+
+bool SESSION::resume()
+{
+    std::ifstream file(journalFile);
+    if (!file.is_open())
+        return false;
+    nlohmann::json previous;
+    try
+    {
+        previous = nlohmann::json::parse(file);
+    }
+    catch (const nlohmann::json::exception &e)
+    {
+        IO::Warn(t("session_journal_corrupted") + ": " + e.what());
+        return false;
+    }
+    file.close();
+    if (!previous.is_object() || !previous.contains("capture"))
+        return false;
+    const std::string productUrl = previous["capture"].value("productUrl", "");
+    if (ARGC::HasArg("no-resume") || (!ARGC::HasArg("batch") && !IO::Confirm(t("resume_previous_session") + " (" + productUrl + ")")))
+    {
+        std::error_code error;
+        std::filesystem::remove(journalFile, error);
+        return false;
+    }
+    journal = previous;
+    IO::Info(t("resuming_session") + ": " + productUrl);
+    return true;
+}
+
+bool SESSION::hasCapture(CAPTURE::CAPTURE_RESULT &result) const
+{
+    if (!journal.contains("capture"))
+        return false;
+    result.productUrl = journal["capture"]["productUrl"];
+    result.request_body = journal["capture"]["requestBody"];
+    return true;
+}
+
+void SESSION::recordCapture(const CAPTURE::CAPTURE_RESULT &result)
+{
+    journal = {{"capture", {{"productUrl", result.productUrl}, {"requestBody", result.request_body}}}};
+    save();
+}
+
+bool SESSION::hasUpdateData(nlohmann::json &updateData) const
+{
+    if (!journal.contains("updateData"))
+        return false;
+    updateData = journal["updateData"];
+    IO::Info(t("resumed_update_data"));
+    return true;
+}
+
+void SESSION::recordUpdateData(const nlohmann::json &updateData)
+{
+    journal["updateData"] = updateData;
+    journal.erase("image");
+    journal.erase("patched");
+    save();
+}
+
+nlohmann::json SESSION::fileStamp(const std::string &path)
+{
+    return {{"path", path},
+            {"size", std::filesystem::file_size(path)},
+            {"writeTime", static_cast<long long>(std::filesystem::last_write_time(path).time_since_epoch().count())}};
+}
+
+bool SESSION::stampMatches(const nlohmann::json &stage)
+{
+    const std::string path = stage.value("path", "");
+    std::error_code error;
+    if (path.empty() || !std::filesystem::exists(path, error))
+        return false;
+    const nlohmann::json stamp = fileStamp(path);
+    return stage.value("size", uint64_t(0)) == stamp["size"].get<uint64_t>() &&
+           stage.value("writeTime", 0LL) == stamp["writeTime"].get<long long>();
+}
+
+bool SESSION::hasImage(std::string &path) const
+{
+    if (!journal.contains("image") || !stampMatches(journal["image"]))
+        return false;
+    path = journal["image"]["path"];
+    IO::Info(t("resumed_image"));
+    return true;
+}
+
+void SESSION::recordImage(const std::string &path, bool written)
+{
+    if (written)
+    {
+        // The journal must never claim bytes that are not on disk yet.
+        MAPPED_FILE image(path, MAPPED_FILE::WRITE);
+        image.flush(0, image.size());
+    }
+    journal["image"] = fileStamp(path);
+    journal.erase("patched");
+    save();
+}
+
+bool SESSION::hasPatch(std::string &path, HASH::PATCH &patch, nlohmann::json &version) const
+{
+    // The patch lives in the journal, so it is as good as the image under it.
+    if (!journal.contains("patched") || !journal.contains("image") || !stampMatches(journal["image"]))
+        return false;
+    const nlohmann::json &patched = journal["patched"];
+    path = journal["image"]["path"];
+    patch.offset = patched.value("offset", size_t(0));
+    patch.bytes = patched.value("hash", "");
+    version = patched["version"];
+    IO::Info(t("resumed_patched_image"));
+    return true;
+}
+
+void SESSION::recordPatch(const HASH::PATCH &patch, const nlohmann::json &version)
+{
+    journal["patched"] = {
+        {"offset", patch.offset},
+        {"hash", patch.bytes},
+        {"version", version}};
+    save();
+}
+
+void SESSION::finish()
+{
+    std::error_code error;
+    std::filesystem::remove(journalFile, error);
+}
+
+void SESSION::save()
+{
+    // Written through and renamed over the old journal, so a crash leaves
+    // either the previous stage or the new one, never half of it.
+    const std::string temporaryFile = journalFile + ".tmp";
+    const std::string content = journal.dump(2, ' ');
+    HANDLE hFile = CreateFile(temporaryFile.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD written = 0;
+    const bool saved = hFile != INVALID_HANDLE_VALUE &&
+                       WriteFile(hFile, content.data(), static_cast<DWORD>(content.size()), &written, NULL) &&
+                       written == content.size() && FlushFileBuffers(hFile);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    if (!saved || !MoveFileEx(temporaryFile.c_str(), journalFile.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        DIE(t("failed_write_session_journal") + ": " + journalFile);
+}
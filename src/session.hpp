@@ -0,0 +1,58 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include "json.hpp"
+#include "capture.hpp"
+#include "hash.hpp"
+
+// Durable record of how far the single-pen flow got: the captured request,
+// the OTA answer, the image file to serve and the patch laid over it with
+// the resulting digests. A run that died resumes at the first stage whose
+// output is missing or no longer matches the file on disk. The journal sits
+// next to the image as <image>.session and is removed once the pen is served.
+class SESSION
+{
+public:
+    explicit SESSION(std::string imageFile);
+    // Offers to resume an unfinished session; --batch always resumes and
+    // --no-resume never does.
+    bool resume();
+
+    bool hasCapture(CAPTURE::CAPTURE_RESULT &result) const;
+    void recordCapture(const CAPTURE::CAPTURE_RESULT &result);
+    bool hasUpdateData(nlohmann::json &updateData) const;
+    void recordUpdateData(const nlohmann::json &updateData);
+    // path may be a cache entry rather than the image file itself. Only an
+    // image this run wrote is flushed; a cache entry is left untouched.
+    bool hasImage(std::string &path) const;
+    void recordImage(const std::string &path, bool written);
+    // version holds md5sum, sha and segmentMd5 of the image as served.
+    bool hasPatch(std::string &path, HASH::PATCH &patch, nlohmann::json &version) const;
+    void recordPatch(const HASH::PATCH &patch, const nlohmann::json &version);
+    void finish();
+
+private:
+    const std::string journalFile;
+    nlohmann::json journal;
+
+    static nlohmann::json fileStamp(const std::string &path);
+    static bool stampMatches(const nlohmann::json &stage);
+    void save();
+};
@@ -0,0 +1,105 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "trace.hpp"
+#include "argc.hpp"
+#include "io.hpp"
+#include "i18n.hpp"
+#include "json.hpp"
+#include <fstream>
+#include <thread>
+#include <map>
+#include <cstdlib>
+
+std::atomic<bool> TRACE::enabled(false);
+std::mutex TRACE::eventsMutex;
+std::vector<TRACE::EVENT> TRACE::events;
+std::string TRACE::filename;
+const std::chrono::steady_clock::time_point TRACE::origin = std::chrono::steady_clock::now();
+
+TRACE::SCOPE::SCOPE(const char *name, const char *category)
+    : name(name), category(category), startUs(IsEnabled() ? nowUs() : -1)
+{
+}
+
+TRACE::SCOPE::~SCOPE()
+{
+    if (startUs >= 0)
+        record(name, category, startUs, nowUs() - startUs);
+}
+
+void TRACE::Initialize()
+{
+    filename = ARGC::GetArg("trace");
+    if (filename.empty())
+        return;
+    events.reserve(4096);
+    enabled = true;
+    // exit() runs this too, so sessions ending in DIE are traced as well.
+    std::atexit(write);
+}
+
+long long TRACE::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+size_t TRACE::threadId()
+{
+    // Small, stable numbers read better in the viewer than native ids.
+    static std::mutex idsMutex;
+    static std::map<std::thread::id, size_t> ids;
+    thread_local size_t id = 0;
+    if (id == 0)
+    {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        id = ids.emplace(std::this_thread::get_id(), ids.size() + 1).first->second;
+    }
+    return id;
+}
+
+void TRACE::record(const char *name, const char *category, long long startUs, long long durationUs)
+{
+    const size_t thread = threadId();
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    events.push_back({name, category, startUs, durationUs, thread});
+}
+
+void TRACE::write()
+{
+    enabled = false;
+    nlohmann::json traceEvents = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex);
+        for (const EVENT &event : events)
+            traceEvents.push_back({{"name", event.name},
+                                   {"cat", event.category},
+                                   {"ph", "X"},
+                                   {"ts", event.startUs},
+                                   {"dur", event.durationUs},
+                                   {"pid", 1},
+                                   {"tid", event.threadId}});
+    }
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file)
+    {
+        IO::Warn(t("cannot_write_trace") + ": " + filename);
+        return;
+    }
+    file << nlohmann::json{{"traceEvents", traceEvents}, {"displayTimeUnit", "ms"}}.dump();
+    IO::Info(t("trace_written") + ": " + filename);
+}
@@ -0,0 +1,70 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Scoped stage timings, written as Chrome trace events when --trace=<file>
+// is given (open the file in chrome://tracing or Perfetto). With tracing
+// off a SCOPE costs one relaxed load.
+class TRACE
+{
+public:
+    class SCOPE
+    {
+    public:
+        explicit SCOPE(const char *name, const char *category = "stage");
+        ~SCOPE();
+        SCOPE(const SCOPE &) = delete;
+        SCOPE &operator=(const SCOPE &) = delete;
+
+    private:
+        const char *name;
+        const char *category;
+        long long startUs;
+    };
+
+    // Reads --trace; the file is written when the process exits.
+    static void Initialize();
+    static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+private:
+    struct EVENT
+    {
+        const char *name;
+        const char *category;
+        long long startUs;
+        long long durationUs;
+        size_t threadId;
+    };
+
+    static std::atomic<bool> enabled;
+    static std::mutex eventsMutex;
+    static std::vector<EVENT> events;
+    static std::string filename;
+    static const std::chrono::steady_clock::time_point origin;
+
+    static long long nowUs();
+    static size_t threadId();
+    static void record(const char *name, const char *category, long long startUs, long long durationUs);
+    static void write();
+};
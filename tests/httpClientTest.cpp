@@ -0,0 +1,296 @@
+// Copyright (C) 2025 Langning Chen
+//
+// This file is part of paper.
+//
+// paper is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// paper is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with paper.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Drives HTTP_CLIENT against a fake OTA server on loopback: pooled
+// keep-alive reuse, a POSTed checkVersion, a HEAD probe, chunked and ranged
+// bodies, and pooled connections the server has closed or drops.
+
+#include "httpClient.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+// HTTP_CLIENT only needs messages for its errors; the keys will do.
+std::string t(const std::string &key) { return key; }
+
+class FAKE_OTA_SERVER
+{
+public:
+    FAKE_OTA_SERVER()
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if (listener == INVALID_SOCKET || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(listener, 8) != 0 || getsockname(listener, (sockaddr *)&address, &length) != 0)
+        {
+            std::cerr << "cannot listen on loopback" << std::endl;
+            std::exit(1);
+        }
+        port = ntohs(address.sin_port);
+        acceptor = std::thread([this]()
+                               { acceptLoop(); });
+    }
+
+    ~FAKE_OTA_SERVER()
+    {
+        stopping = true;
+        // Wake accept() with one last connection.
+        HTTP_CLIENT::SOCKET_HANDLE wake = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        connect(wake, (sockaddr *)&address, sizeof(address));
+        closesocket(wake);
+        acceptor.join();
+        closesocket(listener);
+        for (auto &worker : workers)
+            worker.join();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    std::string url(const std::string &path) const { return "http://127.0.0.1:" + std::to_string(port) + path; }
+    int connections() const { return accepted.load(); }
+
+private:
+    void acceptLoop()
+    {
+        while (true)
+        {
+            HTTP_CLIENT::SOCKET_HANDLE client = accept(listener, nullptr, nullptr);
+            if (client == INVALID_SOCKET || stopping)
+            {
+                if (client != INVALID_SOCKET)
+                    closesocket(client);
+                return;
+            }
+            accepted++;
+            std::lock_guard<std::mutex> lock(workersMutex);
+            workers.emplace_back([this, client]()
+                                 { serve(client); });
+        }
+    }
+
+    static bool readRequest(HTTP_CLIENT::SOCKET_HANDLE client, std::string &pending, std::string &head, std::string &body)
+    {
+        size_t headEnd;
+        char buffer[4096];
+        while ((headEnd = pending.find("\r\n\r\n")) == std::string::npos)
+        {
+            const int received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                return false;
+            pending.append(buffer, received);
+        }
+        head = pending.substr(0, headEnd);
+        pending.erase(0, headEnd + 4);
+        size_t contentLength = 0;
+        const size_t field = head.find("Content-Length: ");
+        if (field != std::string::npos)
+            contentLength = std::stoul(head.substr(field + 16));
+        while (pending.length() < contentLength)
+        {
+            const int received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                return false;
+            pending.append(buffer, received);
+        }
+        body = pending.substr(0, contentLength);
+        pending.erase(0, contentLength);
+        return true;
+    }
+
+    static void reply(HTTP_CLIENT::SOCKET_HANDLE client, const std::string &response)
+    {
+        send(client, response.data(), (int)response.length(), 0);
+    }
+
+    void serve(HTTP_CLIENT::SOCKET_HANDLE client)
+    {
+        static const std::string IMAGE = "0123456789";
+        std::string pending, head, body;
+        bool dropNext = false;
+        while (readRequest(client, pending, head, body) && !dropNext)
+        {
+            const std::string requestLine = head.substr(0, head.find("\r\n"));
+            if (requestLine == "POST /ota/checkVersion HTTP/1.1")
+                reply(client, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                                  std::to_string(body.length()) + "\r\n\r\n" + body);
+            else if (requestLine == "HEAD /image.img HTTP/1.1")
+                reply(client, "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: 10\r\n\r\n");
+            else if (requestLine == "GET /image.img HTTP/1.1" && head.find("Range: bytes=2-5") != std::string::npos)
+                reply(client, "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes 2-5/10\r\nContent-Length: 4\r\n\r\n" +
+                                  IMAGE.substr(2, 4));
+            else if (requestLine == "GET /image.img HTTP/1.1")
+                reply(client, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n" + IMAGE);
+            else if (requestLine == "GET /chunked HTTP/1.1")
+                reply(client, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                              "4\r\nWiki\r\n5;name=value\r\npedia\r\n0\r\nTrailer: x\r\n\r\n");
+            else if (requestLine == "GET /last HTTP/1.1")
+            {
+                // Keep-alive as far as the client can tell, then gone.
+                reply(client, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+                break;
+            }
+            else if (requestLine == "GET /drop-next HTTP/1.1")
+            {
+                // The next request on this connection is read, then dropped
+                // unanswered, as by a server that timed the connection out.
+                reply(client, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+                dropNext = true;
+            }
+            else
+                reply(client, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        }
+        closesocket(client);
+    }
+
+    HTTP_CLIENT::SOCKET_HANDLE listener;
+    int port = 0;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> accepted{0};
+    std::thread acceptor;
+    std::mutex workersMutex;
+    std::vector<std::thread> workers;
+};
+
+static int failures = 0;
+
+#define CHECK(condition)                                                              \
+    do                                                                                \
+    {                                                                                 \
+        if (!(condition))                                                             \
+        {                                                                             \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+static void testPooledRequests(HTTP_CLIENT &client, FAKE_OTA_SERVER &server)
+{
+    HTTP_CLIENT::RESPONSE response;
+    const std::string body = R"({"mid":"7E92000008705369","version":"4.7.7"})";
+    CHECK(client.request("POST", server.url("/ota/checkVersion"), {{"Content-Type", "application/json"}}, body, response));
+    CHECK(response.statusCode == 200);
+    CHECK(response.body == body);
+
+    CHECK(client.request("HEAD", server.url("/image.img"), {}, "", response));
+    CHECK(response.statusCode == 200);
+    CHECK(response.getHeader("content-length") == "10");
+    CHECK(response.getHeader("accept-ranges") == "bytes");
+    CHECK(response.body.empty());
+
+    CHECK(client.request("GET", server.url("/image.img"), {}, "", response));
+    CHECK(response.body == "0123456789");
+    CHECK(server.connections() == 1);
+}
+
+static void testChunkedBody(HTTP_CLIENT &client, FAKE_OTA_SERVER &server)
+{
+    HTTP_CLIENT::RESPONSE response;
+    std::string streamed;
+    CHECK(client.request("GET", server.url("/chunked"), {}, "", response, nullptr,
+                         [&streamed](const char *data, size_t length)
+                         {
+                             streamed.append(data, length);
+                             return true;
+                         }));
+    CHECK(response.statusCode == 200);
+    CHECK(streamed == "Wikipedia");
+    CHECK(server.connections() == 1);
+}
+
+static void testRangedBody(HTTP_CLIENT &client, FAKE_OTA_SERVER &server)
+{
+    HTTP_CLIENT::RESPONSE response;
+    CHECK(client.request("GET", server.url("/image.img"), {{"Range", "bytes=2-5"}}, "", response));
+    CHECK(response.statusCode == 206);
+    CHECK(response.getHeader("content-range") == "bytes 2-5/10");
+    CHECK(response.body == "2345");
+    CHECK(server.connections() == 1);
+}
+
+static void testServerClosedIdleConnection(HTTP_CLIENT &client, FAKE_OTA_SERVER &server)
+{
+    HTTP_CLIENT::RESPONSE response;
+    CHECK(client.request("GET", server.url("/last"), {}, "", response));
+    CHECK(response.body == "ok");
+    // Let the close reach the pooled socket before it is used again.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(client.request("GET", server.url("/image.img"), {}, "", response));
+    CHECK(response.statusCode == 200);
+    CHECK(response.body == "0123456789");
+    CHECK(server.connections() == 2);
+}
+
+static void testDroppedReusedConnection(HTTP_CLIENT &client, FAKE_OTA_SERVER &server)
+{
+    HTTP_CLIENT::RESPONSE response;
+    const int before = server.connections();
+    CHECK(client.request("GET", server.url("/drop-next"), {}, "", response));
+    CHECK(response.body == "ok");
+    // Fails on the pooled connection without a byte of response, so the
+    // client retries once on a fresh one.
+    CHECK(client.request("GET", server.url("/image.img"), {}, "", response));
+    CHECK(response.statusCode == 200);
+    CHECK(response.body == "0123456789");
+    CHECK(server.connections() == before + 1);
+}
+
+int main()
+{
+    FAKE_OTA_SERVER server;
+    {
+        HTTP_CLIENT client(5000);
+        testPooledRequests(client, server);
+        testChunkedBody(client, server);
+        testRangedBody(client, server);
+        testServerClosedIdleConnection(client, server);
+        testDroppedReusedConnection(client, server);
+    }
+    if (failures > 0)
+        std::cerr << failures << " check(s) failed" << std::endl;
+    return failures > 0 ? 1 : 0;
+}